@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Tells the CPU that we are in a spin loop
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+struct NoCompletion
+{
+    void operator()() noexcept
+    {
+    }
+};
+
+// A drop-in for std::barrier that spins before it parks the waiting threads.
+// The waiters watch a phase counter, the last thread to arrive runs the
+// completion and then advances the phase. This is sense reversal with a counter
+// instead of a flag. Only if someone is parked on the phase
+// does it need to make a system call to wake them up.
+//
+// How long to spin is adapted to the measured length of a phase: short phases
+// are spun through, long ones park almost right away.
+template <class Completion = NoCompletion>
+class SpinBarrier
+{
+public:
+    // Phases longer than this park after a short spin
+    static constexpr int64_t MAX_SPIN_NS = 100000;
+    static constexpr int64_t MIN_SPIN_NS = 1000;
+    static constexpr int YIELDS = 8;
+
+    SpinBarrier(int count, Completion completion = Completion(), int64_t max_spin_ns = MAX_SPIN_NS)
+        : m_completion(completion),
+          m_expected(count),
+          m_remaining(count),
+          m_max_spin_ns(max_spin_ns),
+          m_last_phase_end(now())
+    {
+        // Spinning only keeps the thread we are waiting for off the CPU
+        if (std::thread::hardware_concurrency() < 2)
+        {
+            m_max_spin_ns = 0;
+        }
+
+        m_spin_ns.store(m_max_spin_ns > 0 ? MIN_SPIN_NS : 0, std::memory_order_relaxed);
+    }
+
+    SpinBarrier(const SpinBarrier &) = delete;
+    SpinBarrier &operator=(const SpinBarrier &) = delete;
+
+    void arrive_and_wait()
+    {
+        uint32_t phase = m_phase.load(std::memory_order_acquire);
+
+        if (!arrive(phase))
+        {
+            wait(phase);
+        }
+    }
+
+    // Arrives without waiting and leaves the barrier for the following phases
+    void arrive_and_drop()
+    {
+        m_expected.fetch_sub(1, std::memory_order_relaxed);
+        arrive(m_phase.load(std::memory_order_acquire));
+    }
+
+    // How long the waiters currently spin before parking
+    int64_t spin_ns() const
+    {
+        return m_spin_ns.load(std::memory_order_relaxed);
+    }
+
+private:
+    static int64_t now()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Returns true if this was the last thread to arrive
+    bool arrive(uint32_t phase)
+    {
+        if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return false;
+        }
+
+        m_completion();
+        adapt();
+
+        m_remaining.store(m_expected.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_phase.store(phase + 1, std::memory_order_seq_cst);
+
+        if (m_sleepers.load(std::memory_order_seq_cst) > 0)
+        {
+            m_phase.notify_all();
+        }
+
+        return true;
+    }
+
+    void wait(uint32_t phase)
+    {
+        int64_t budget = m_spin_ns.load(std::memory_order_relaxed);
+
+        if (budget > 0)
+        {
+            int64_t start = now();
+
+            for (int i = 1; m_phase.load(std::memory_order_acquire) == phase; i++)
+            {
+                cpu_relax();
+
+                // Reading the clock costs about as much as a few dozen pauses
+                if (i % 64 == 0 && now() - start > budget)
+                {
+                    break;
+                }
+            }
+        }
+        else
+        {
+            // Without spare cores, letting the thread we wait for run is still
+            // cheaper than a round trip through the futex
+            for (int i = 0; i < YIELDS && m_phase.load(std::memory_order_acquire) == phase; i++)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (m_phase.load(std::memory_order_acquire) == phase)
+        {
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+
+            while (m_phase.load(std::memory_order_seq_cst) == phase)
+            {
+                m_phase.wait(phase, std::memory_order_acquire);
+            }
+
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Runs on the last thread to arrive, before the phase flips
+    void adapt()
+    {
+        int64_t end = now();
+        int64_t length = end - m_last_phase_end;
+        m_last_phase_end = end;
+
+        // A moving average so that a single slow phase doesn't switch the mode
+        m_avg_phase_ns += (length - m_avg_phase_ns) / 8;
+
+        int64_t budget = 0;
+
+        if (m_max_spin_ns > 0)
+        {
+            budget = m_avg_phase_ns < m_max_spin_ns ? std::min(2 * m_avg_phase_ns, m_max_spin_ns) : MIN_SPIN_NS;
+            budget = std::max(budget, MIN_SPIN_NS);
+        }
+
+        m_spin_ns.store(budget, std::memory_order_relaxed);
+    }
+
+    Completion m_completion;
+    std::atomic<int> m_expected;
+
+    // The counter everybody decrements and the phase the waiters spin on are
+    // kept on separate cache lines
+    alignas(64) std::atomic<int> m_remaining;
+    alignas(64) std::atomic<uint32_t> m_phase{0};
+    std::atomic<int> m_sleepers{0};
+    std::atomic<int64_t> m_spin_ns{0};
+
+    // Only touched by the last thread to arrive
+    alignas(64) int64_t m_max_spin_ns;
+    int64_t m_last_phase_end;
+    int64_t m_avg_phase_ns{0};
+};
@@ -0,0 +1,41 @@
+#include "bench.hh"
+#include "game.hh"
+
+#include <chrono>
+#include <iomanip>
+
+void layout_benchmark(std::ostream &out, int tile_size, int generations)
+{
+    using namespace std::chrono;
+    const int CELLS = 1 << 24;
+
+    out << std::setw(10) << "width" << std::setw(10) << "height" << std::setw(12) << "layout"
+        << std::setw(12) << "ms/gen" << std::setw(14) << "Mcells/s" << std::endl;
+
+    for (int width = 1 << 10; width <= 1 << 20; width <<= 2)
+    {
+        int height = std::max(64, CELLS / width);
+
+        for (Layout layout : {Layout::RowMajor, Layout::Tiled})
+        {
+            Game game(height, width, Boundary::Torus, {layout, tile_size});
+
+            // The first generation pays for the page faults
+            game.tick();
+
+            auto start = steady_clock::now();
+
+            for (int i = 0; i < generations; i++)
+            {
+                game.tick();
+            }
+
+            double ms = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000.0 / generations;
+            double rate = double(width) * height / ms / 1000.0;
+
+            out << std::setw(10) << width << std::setw(10) << height << std::setw(12) << layout_name(layout)
+                << std::setw(12) << std::fixed << std::setprecision(3) << ms
+                << std::setw(14) << std::setprecision(1) << rate << std::endl;
+        }
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <ostream>
+
+// Compares the row-major and tiled layouts on boards from 1k to 1M cells wide.
+// The boards have the same number of cells, apart from the widest ones which
+// are kept at least 64 rows high.
+void layout_benchmark(std::ostream &out, int tile_size, int generations);
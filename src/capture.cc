@@ -0,0 +1,325 @@
+#include "capture.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+namespace
+{
+    const int MAX_STRIDE = 1024;
+
+    struct RGB
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    RGB expand_rgb332(uint8_t c)
+    {
+        return {uint8_t(((c >> 5) & 7) * 255 / 7), uint8_t(((c >> 2) & 7) * 255 / 7), uint8_t((c & 3) * 255 / 3)};
+    }
+
+    // BT.601 studio swing, what most players assume for Y4M input
+    std::array<uint8_t, 3> to_yuv(uint8_t c)
+    {
+        RGB rgb = expand_rgb332(c);
+        int y = (66 * rgb.r + 129 * rgb.g + 25 * rgb.b + 128) / 256 + 16;
+        int u = (-38 * rgb.r - 74 * rgb.g + 112 * rgb.b + 128) / 256 + 128;
+        int v = (112 * rgb.r - 94 * rgb.g - 18 * rgb.b + 128) / 256 + 128;
+        return {uint8_t(y), uint8_t(u), uint8_t(v)};
+    }
+
+    class Crc32
+    {
+    public:
+        Crc32()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+
+                for (int k = 0; k < 8; k++)
+                {
+                    c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                }
+
+                m_table[n] = c;
+            }
+        }
+
+        uint32_t update(uint32_t crc, const uint8_t *data, size_t len) const
+        {
+            crc = ~crc;
+
+            for (size_t i = 0; i < len; i++)
+            {
+                crc = m_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+
+            return ~crc;
+        }
+
+    private:
+        std::array<uint32_t, 256> m_table;
+    };
+
+    const Crc32 s_crc;
+
+    void put_be32(std::vector<uint8_t> &out, uint32_t value)
+    {
+        out.push_back(value >> 24);
+        out.push_back(value >> 16);
+        out.push_back(value >> 8);
+        out.push_back(value);
+    }
+
+    void put_chunk(std::ofstream &out, const char *type, const std::vector<uint8_t> &data)
+    {
+        std::vector<uint8_t> chunk;
+        put_be32(chunk, data.size());
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        put_be32(chunk, s_crc.update(0, chunk.data() + 4, chunk.size() - 4));
+        out.write((const char *)chunk.data(), chunk.size());
+    }
+
+    // A zlib stream made of stored deflate blocks. The frames are 1-bit images
+    // so compressing them isn't worth the encoder time.
+    std::vector<uint8_t> zlib_store(const std::vector<uint8_t> &data)
+    {
+        const size_t BLOCK = 65535;
+        std::vector<uint8_t> out{0x78, 0x01};
+        uint32_t a = 1;
+        uint32_t b = 0;
+
+        for (size_t pos = 0; pos < data.size() || pos == 0; pos += BLOCK)
+        {
+            size_t len = std::min(BLOCK, data.size() - pos);
+            bool last = pos + len >= data.size();
+            out.push_back(last ? 1 : 0);
+            out.push_back(len & 0xff);
+            out.push_back(len >> 8);
+            out.push_back(~len & 0xff);
+            out.push_back((~len >> 8) & 0xff);
+            out.insert(out.end(), data.begin() + pos, data.begin() + pos + len);
+
+            if (last)
+            {
+                break;
+            }
+        }
+
+        for (uint8_t c : data)
+        {
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+
+        put_be32(out, (b << 16) | a);
+        return out;
+    }
+
+    uint8_t reverse_bits(uint8_t v)
+    {
+        v = (v & 0xf0) >> 4 | (v & 0x0f) << 4;
+        v = (v & 0xcc) >> 2 | (v & 0x33) << 2;
+        v = (v & 0xaa) >> 1 | (v & 0x55) << 1;
+        return v;
+    }
+}
+
+FrameCapture::FrameCapture(CaptureFormat format, std::string path, int width, int height,
+                           int interval, int fps, size_t queue_size)
+    : m_format(format),
+      m_path(path),
+      m_width(width),
+      m_height(height),
+      m_words_per_row((width + 63) / 64),
+      m_interval(std::max(interval, 1)),
+      m_fps(fps),
+      m_stride(m_interval)
+{
+    if (m_format == CaptureFormat::Y4M)
+    {
+        m_video.open(m_path, std::ios::binary);
+
+        if (!m_video)
+        {
+            throw Error("Could not open " + m_path + " for writing");
+        }
+
+        m_video << "YUV4MPEG2 W" << m_width << " H" << m_height << " F" << m_fps << ":1 Ip A1:1 C444\n";
+    }
+
+    for (size_t i = 0; i < queue_size; i++)
+    {
+        m_free.push_back(std::make_unique<Frame>());
+        m_free.back()->bits.resize(m_words_per_row * m_height);
+    }
+
+    m_thread = std::thread(&FrameCapture::encoder_thr, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::lock_guard guard(m_lock);
+        m_running = false;
+    }
+
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+void FrameCapture::offer(uint64_t generation, const uint64_t *bits)
+{
+    int stride = m_stride.load(std::memory_order_relaxed);
+
+    if (generation % stride != 0)
+    {
+        return;
+    }
+
+    std::unique_lock guard(m_lock, std::try_to_lock);
+
+    if (!guard.owns_lock() || m_free.empty())
+    {
+        // The encoder is behind, skip this one and capture less often until it catches up
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_stride.store(std::min(stride * 2, MAX_STRIDE), std::memory_order_relaxed);
+        return;
+    }
+
+    auto frame = std::move(m_free.back());
+    m_free.pop_back();
+
+    frame->generation = generation;
+    frame->alive_color = m_alive_color.load(std::memory_order_relaxed);
+    frame->dead_color = m_dead_color.load(std::memory_order_relaxed);
+    std::copy(bits, bits + frame->bits.size(), frame->bits.begin());
+
+    if (m_queue.empty() && stride > m_interval)
+    {
+        m_stride.store(std::max(stride / 2, m_interval), std::memory_order_relaxed);
+    }
+
+    m_queue.push_back(std::move(frame));
+    guard.unlock();
+    m_cond.notify_one();
+}
+
+void FrameCapture::set_palette(uint8_t alive, uint8_t dead)
+{
+    m_alive_color.store(alive, std::memory_order_relaxed);
+    m_dead_color.store(dead, std::memory_order_relaxed);
+}
+
+void FrameCapture::encoder_thr()
+{
+    std::unique_lock guard(m_lock);
+
+    while (true)
+    {
+        m_cond.wait(guard, [this]()
+                    { return !m_queue.empty() || !m_running; });
+
+        if (m_queue.empty())
+        {
+            // Stopped and everything that was queued has been written
+            break;
+        }
+
+        auto frame = std::move(m_queue.front());
+        m_queue.pop_front();
+        guard.unlock();
+
+        if (m_format == CaptureFormat::Y4M)
+        {
+            write_y4m(*frame);
+        }
+        else
+        {
+            write_png(*frame);
+        }
+
+        m_written.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
+        m_free.push_back(std::move(frame));
+    }
+}
+
+bool FrameCapture::alive(const Frame &frame, int x, int y) const
+{
+    return (frame.bits[y * m_words_per_row + x / 64] >> (x % 64)) & 1;
+}
+
+void FrameCapture::write_y4m(const Frame &frame)
+{
+    auto alive = to_yuv(frame.alive_color);
+    auto dead = to_yuv(frame.dead_color);
+    std::vector<uint8_t> row(m_width);
+
+    m_video << "FRAME\n";
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        for (int y = 0; y < m_height; y++)
+        {
+            for (int x = 0; x < m_width; x++)
+            {
+                row[x] = this->alive(frame, x, y) ? alive[plane] : dead[plane];
+            }
+
+            m_video.write((const char *)row.data(), row.size());
+        }
+    }
+
+    m_video.flush();
+}
+
+void FrameCapture::write_png(const Frame &frame)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%06llu.png", (unsigned long long)written());
+    std::ofstream out(m_path + suffix, std::ios::binary);
+
+    if (!out)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write((const char *)signature, sizeof(signature));
+
+    // 1-bit indexed image: index 0 is a dead cell, index 1 an alive one
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, m_width);
+    put_be32(ihdr, m_height);
+    ihdr.insert(ihdr.end(), {1, 3, 0, 0, 0});
+    put_chunk(out, "IHDR", ihdr);
+
+    RGB dead = expand_rgb332(frame.dead_color);
+    RGB alive = expand_rgb332(frame.alive_color);
+    put_chunk(out, "PLTE", {dead.r, dead.g, dead.b, alive.r, alive.g, alive.b});
+
+    // The packed rows are LSB-first, PNG wants the leftmost pixel in the MSB
+    const int row_bytes = (m_width + 7) / 8;
+    std::vector<uint8_t> raw;
+    raw.reserve((row_bytes + 1) * m_height);
+
+    for (int y = 0; y < m_height; y++)
+    {
+        const uint64_t *row = &frame.bits[y * m_words_per_row];
+        raw.push_back(0);
+
+        for (int i = 0; i < row_bytes; i++)
+        {
+            raw.push_back(reverse_bits(row[i / 8] >> (8 * (i % 8))));
+        }
+    }
+
+    put_chunk(out, "IDAT", zlib_store(raw));
+    put_chunk(out, "IEND", {});
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "common.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat
+{
+    Y4M,
+    PNG,
+};
+
+// One captured generation, stored as packed bits: cell x of row y is bit x % 64
+// of word y * words_per_row + x / 64.
+struct Frame
+{
+    uint64_t generation = 0;
+    uint8_t alive_color = 0;
+    uint8_t dead_color = 0;
+    std::vector<uint64_t> bits;
+};
+
+// Records generations into a video file or an image sequence. The simulation
+// side only ever copies the packed grid into a pre-allocated frame, all encoding
+// happens in a background thread. If the encoder falls behind, frames are
+// dropped and the capture interval is stretched until the queue recovers.
+class FrameCapture
+{
+public:
+    // For PNG captures the path is used as a prefix for the numbered files
+    FrameCapture(CaptureFormat format, std::string path, int width, int height,
+                 int interval = 1, int fps = 30, size_t queue_size = 8);
+
+    ~FrameCapture();
+
+    // Called once per generation with the packed grid. Never blocks.
+    void offer(uint64_t generation, const uint64_t *bits);
+
+    void set_palette(uint8_t alive, uint8_t dead);
+
+    CaptureFormat format() const
+    {
+        return m_format;
+    }
+
+    uint64_t written() const
+    {
+        return m_written.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    int interval() const
+    {
+        return m_stride.load(std::memory_order_relaxed);
+    }
+
+private:
+    void encoder_thr();
+    void write_y4m(const Frame &frame);
+    void write_png(const Frame &frame);
+    bool alive(const Frame &frame, int x, int y) const;
+
+    CaptureFormat m_format;
+    std::string m_path;
+    int m_width;
+    int m_height;
+    int m_words_per_row;
+    int m_interval;
+    int m_fps;
+    std::ofstream m_video;
+
+    std::atomic<int> m_stride;
+    std::atomic<uint8_t> m_alive_color{0x00};
+    std::atomic<uint8_t> m_dead_color{0xff};
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_dropped{0};
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::vector<std::unique_ptr<Frame>> m_free;
+    std::deque<std::unique_ptr<Frame>> m_queue;
+    bool m_running{true};
+    std::thread m_thread;
+};
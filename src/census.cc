@@ -0,0 +1,853 @@
+#include "census.hh"
+
+#include <algorithm>
+#include <bit>
+#include <thread>
+
+namespace
+{
+    // Cells this close to each other belong to the same object, one is not
+    // enough for e.g. the spaceships
+    const int REACH = 2;
+
+    // A horizontal run of live cells, x1 is inclusive
+    struct Run
+    {
+        int y;
+        int x0;
+        int x1;
+    };
+
+    // The rows of a band of the board, labelled on their own
+    struct Band
+    {
+        int y_start = 0;
+        int y_end = 0;
+        std::vector<Run> runs;
+        // Index of the first run of every row, and one past the last run
+        std::vector<int> row_start;
+        std::vector<int> parent;
+    };
+
+    int find(std::vector<int> &parent, int i)
+    {
+        // Path halving
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+
+        return i;
+    }
+
+    void unite(std::vector<int> &parent, int a, int b)
+    {
+        a = find(parent, a);
+        b = find(parent, b);
+
+        // The root is always the first run of the component
+        if (a < b)
+        {
+            parent[b] = a;
+        }
+        else if (b < a)
+        {
+            parent[a] = b;
+        }
+    }
+
+    // Unites the runs of two rows at most REACH apart, [a, a_end) and
+    // [b, b_end), that are within REACH of each other
+    void join_rows(const std::vector<Run> &runs, std::vector<int> &parent, int a, int a_end, int b, int b_end,
+                   int width, bool wrap)
+    {
+        if (a == a_end || b == b_end)
+        {
+            return;
+        }
+
+        const int first_a = a;
+        const int first_b = b;
+
+        while (a < a_end && b < b_end)
+        {
+            if (runs[a].x1 + REACH < runs[b].x0)
+            {
+                a++;
+            }
+            else if (runs[b].x1 + REACH < runs[a].x0)
+            {
+                b++;
+            }
+            else
+            {
+                unite(parent, a, b);
+
+                if (runs[a].x1 < runs[b].x1)
+                {
+                    a++;
+                }
+                else
+                {
+                    b++;
+                }
+            }
+        }
+
+        // Across the left and right edges, only the first and the last run of
+        // a row can be close enough
+        if (wrap)
+        {
+            if (runs[first_a].x0 + width - runs[b_end - 1].x1 <= REACH)
+            {
+                unite(parent, first_a, b_end - 1);
+            }
+
+            if (runs[first_b].x0 + width - runs[a_end - 1].x1 <= REACH)
+            {
+                unite(parent, first_b, a_end - 1);
+            }
+        }
+    }
+
+    // join_rows() across the top and bottom edges of a Klein bottle, where the
+    // row [a, a_end) is seen flipped horizontally
+    void join_rows_flipped(const std::vector<Run> &runs, std::vector<int> &parent, int a, int a_end, int b, int b_end,
+                           int width)
+    {
+        std::vector<Run> seam;
+        std::vector<int> ids;
+
+        for (int i = a_end - 1; i >= a; i--)
+        {
+            seam.push_back({runs[i].y, width - 1 - runs[i].x1, width - 1 - runs[i].x0});
+            ids.push_back(i);
+        }
+
+        for (int i = b; i < b_end; i++)
+        {
+            seam.push_back(runs[i]);
+            ids.push_back(i);
+        }
+
+        const int count_a = a_end - a;
+        std::vector<int> seam_parent(seam.size());
+
+        for (size_t i = 0; i < seam.size(); i++)
+        {
+            seam_parent[i] = i;
+        }
+
+        join_rows(seam, seam_parent, 0, count_a, count_a, seam.size(), width, true);
+
+        for (size_t i = 0; i < seam.size(); i++)
+        {
+            unite(parent, ids[i], ids[find(seam_parent, i)]);
+        }
+    }
+
+    // The first cell at or after x that is alive, or dead, or width if there is
+    // none
+    int next_cell(const uint64_t *words, int width, int x, bool alive)
+    {
+        while (x < width)
+        {
+            uint64_t word = (alive ? words[x / 64] : ~words[x / 64]) >> (x % 64);
+
+            if (word)
+            {
+                return std::min(width, x + std::countr_zero(word));
+            }
+
+            x = (x / 64 + 1) * 64;
+        }
+
+        return width;
+    }
+
+    void label_band(const Snapshot &snapshot, bool wrap, Band &band)
+    {
+        const int width = snapshot.width;
+
+        for (int y = band.y_start; y < band.y_end; y++)
+        {
+            const uint64_t *words = &snapshot.bits[size_t(y) * snapshot.words_per_row];
+            const int row = band.runs.size();
+            band.row_start.push_back(row);
+
+            for (int x = next_cell(words, width, 0, true); x < width;)
+            {
+                int end = next_cell(words, width, x, false);
+                int run = band.runs.size();
+                band.parent.push_back(run);
+                band.runs.push_back({y, x, end - 1});
+
+                if (run > row && band.runs[run - 1].x1 + REACH >= x)
+                {
+                    unite(band.parent, run - 1, run);
+                }
+
+                x = next_cell(words, width, end, true);
+            }
+
+            const int row_end = band.runs.size();
+
+            if (wrap && row_end - row > 1 && band.runs[row].x0 + width - band.runs[row_end - 1].x1 <= REACH)
+            {
+                unite(band.parent, row, row_end - 1);
+            }
+
+            for (int above = std::max(band.y_start, y - REACH); above < y; above++)
+            {
+                int i = above - band.y_start;
+                join_rows(band.runs, band.parent, band.row_start[i], band.row_start[i + 1], row, row_end, width, wrap);
+            }
+        }
+
+        band.row_start.push_back(band.runs.size());
+    }
+
+    // The offset to subtract from the coordinates of an object on a torus so
+    // that it doesn't cross the edge: the start of the occupied interval after
+    // the largest gap. Returns -1 if the object goes all the way around.
+    int unwrap_offset(std::vector<std::pair<int, int>> &intervals, int size)
+    {
+        std::sort(intervals.begin(), intervals.end());
+
+        const int first = intervals.front().first;
+        int end = intervals.front().second;
+        int offset = first;
+        int largest_gap = 0;
+
+        for (const auto &[start, last] : intervals)
+        {
+            if (start - end - 1 > largest_gap)
+            {
+                largest_gap = start - end - 1;
+                offset = start;
+            }
+
+            end = std::max(end, last);
+        }
+
+        // The gap that goes around the edge
+        if (size - 1 - end + first >= largest_gap)
+        {
+            largest_gap = size - 1 - end + first;
+            offset = first;
+        }
+
+        return largest_gap > 0 ? offset : -1;
+    }
+}
+
+const char *object_kind_name(ObjectKind kind)
+{
+    switch (kind)
+    {
+    case ObjectKind::StillLife:
+        return "still life";
+    case ObjectKind::Oscillator:
+        return "oscillator";
+    case ObjectKind::Spaceship:
+        return "spaceship";
+    case ObjectKind::Other:
+        return "other";
+    }
+
+    return "unknown";
+}
+
+Census::Census(const Rule &rule, int threads)
+    : m_rule(rule),
+      m_threads(threads > 0 ? threads : THREADS),
+      m_start(m_threads),
+      m_done(m_threads)
+{
+    for (int i = 1; i < m_threads; i++)
+    {
+        m_pool.emplace_back(&Census::pool_thr, this, i);
+    }
+}
+
+Census::~Census()
+{
+    if (!m_pool.empty())
+    {
+        m_stopping = true;
+        m_start.arrive_and_wait();
+
+        for (auto &thread : m_pool)
+        {
+            thread.join();
+        }
+    }
+}
+
+void Census::run_parallel(int count, const std::function<void(int)> &job)
+{
+    if (count <= 1 || m_pool.empty())
+    {
+        for (int i = 0; i < count; i++)
+        {
+            job(i);
+        }
+
+        return;
+    }
+
+    m_job = &job;
+    m_job_count = count;
+    m_start.arrive_and_wait();
+    job(0);
+    m_done.arrive_and_wait();
+}
+
+void Census::pool_thr(int index)
+{
+    while (true)
+    {
+        m_start.arrive_and_wait();
+
+        if (m_stopping)
+        {
+            return;
+        }
+
+        if (index < m_job_count)
+        {
+            (*m_job)(index);
+        }
+
+        m_done.arrive_and_wait();
+    }
+}
+
+std::vector<CensusEntry> Census::take(const Snapshot &snapshot, Boundary boundary)
+{
+    const int width = snapshot.width;
+    const int height = snapshot.height;
+    // A Klein bottle wraps like a torus, except that crossing the top or
+    // bottom edge flips the board horizontally
+    const bool wrap = boundary == Boundary::Torus || boundary == Boundary::Klein;
+    const bool flip = boundary == Boundary::Klein;
+    const int threads = std::clamp(m_threads, 1, std::max(height, 1));
+
+    std::vector<Band> bands(threads);
+
+    run_parallel(threads, [&](int i)
+                 {
+                     bands[i].y_start = i * height / threads;
+                     bands[i].y_end = (i + 1) * height / threads;
+                     label_band(snapshot, wrap, bands[i]); });
+
+    // The bands are joined into one list of runs
+    std::vector<Run> runs;
+    std::vector<int> parent;
+    std::vector<int> row_start;
+
+    for (const Band &band : bands)
+    {
+        int offset = runs.size();
+        runs.insert(runs.end(), band.runs.begin(), band.runs.end());
+
+        for (int p : band.parent)
+        {
+            parent.push_back(p + offset);
+        }
+
+        for (size_t i = 0; i + 1 < band.row_start.size(); i++)
+        {
+            row_start.push_back(band.row_start[i] + offset);
+        }
+    }
+
+    row_start.push_back(runs.size());
+
+    // The rows close to each other across the band borders, and across the top
+    // and bottom edges of a torus
+    auto join_across = [&](int border)
+    {
+        for (int a = border - REACH; a < border; a++)
+        {
+            for (int b = border; b <= a + REACH; b++)
+            {
+                if (!wrap && (a < 0 || b >= height))
+                {
+                    continue;
+                }
+
+                int row_a = (a + height) % height;
+                int row_b = b % height;
+
+                if (flip && border == height)
+                {
+                    join_rows_flipped(runs, parent, row_start[row_a], row_start[row_a + 1], row_start[row_b],
+                                      row_start[row_b + 1], width);
+                }
+                else
+                {
+                    join_rows(runs, parent, row_start[row_a], row_start[row_a + 1], row_start[row_b],
+                              row_start[row_b + 1], width, wrap);
+                }
+            }
+        }
+    };
+
+    for (int i = 1; i < threads; i++)
+    {
+        if (bands[i].y_start > 0)
+        {
+            join_across(bands[i].y_start);
+        }
+    }
+
+    if (wrap)
+    {
+        join_across(height);
+    }
+
+    // The runs are grouped by component, the root of a component is its first run
+    std::vector<int> component(runs.size());
+    int components = 0;
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        int root = find(parent, i);
+        component[i] = root == int(i) ? components++ : component[root];
+    }
+
+    std::vector<int> start(components + 1, 0);
+
+    for (int c : component)
+    {
+        start[c + 1]++;
+    }
+
+    for (int c = 0; c < components; c++)
+    {
+        start[c + 1] += start[c];
+    }
+
+    std::vector<int> order(runs.size());
+    std::vector<int> next = start;
+
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        order[next[component[i]]++] = i;
+    }
+
+    // Every component as a shape in its bounding box, width 0 if it is too
+    // large to classify
+    std::vector<Shape> shapes(components);
+    std::vector<std::string> keys(components);
+
+    const int workers = std::clamp(components, 1, threads);
+
+    run_parallel(workers, [&](int t)
+                 {
+                     std::vector<std::pair<int, int>> columns;
+                     std::vector<std::pair<int, int>> rows;
+
+                     for (int c = t * components / workers; c < (t + 1) * components / workers; c++)
+                     {
+                         int offset_x = 0;
+                         int offset_y = 0;
+
+                         // On a Klein bottle the rows above the offset are
+                         // moved below the others, which flips them
+                         auto columns_of = [&](const Run &run)
+                         {
+                             return flip && run.y < offset_y ? std::pair(width - 1 - run.x1, width - 1 - run.x0)
+                                                             : std::pair(run.x0, run.x1);
+                         };
+
+                         if (wrap)
+                         {
+                             columns.clear();
+                             rows.clear();
+
+                             for (int i = start[c]; i < start[c + 1]; i++)
+                             {
+                                 rows.emplace_back(runs[order[i]].y, runs[order[i]].y);
+                             }
+
+                             offset_y = unwrap_offset(rows, height);
+
+                             if (offset_y < 0)
+                             {
+                                 continue;
+                             }
+
+                             for (int i = start[c]; i < start[c + 1]; i++)
+                             {
+                                 columns.push_back(columns_of(runs[order[i]]));
+                             }
+
+                             offset_x = unwrap_offset(columns, width);
+
+                             if (offset_x < 0)
+                             {
+                                 continue;
+                             }
+                         }
+
+                         auto to_x = [&](int x) { return (x - offset_x + width) % width; };
+                         auto to_y = [&](int y) { return (y - offset_y + height) % height; };
+
+                         int min_x = INT_MAX;
+                         int min_y = INT_MAX;
+                         int max_x = INT_MIN;
+                         int max_y = INT_MIN;
+
+                         for (int i = start[c]; i < start[c + 1]; i++)
+                         {
+                             const Run &run = runs[order[i]];
+                             auto [x0, x1] = columns_of(run);
+                             min_x = std::min(min_x, to_x(x0));
+                             max_x = std::max(max_x, to_x(x1));
+                             min_y = std::min(min_y, to_y(run.y));
+                             max_y = std::max(max_y, to_y(run.y));
+                         }
+
+                         Shape &shape = shapes[c];
+
+                         if (max_x - min_x >= MAX_SIZE || max_y - min_y >= MAX_SIZE)
+                         {
+                             continue;
+                         }
+
+                         shape.width = max_x - min_x + 1;
+                         shape.height = max_y - min_y + 1;
+                         shape.cells.assign(shape.width * shape.height, 0);
+
+                         for (int i = start[c]; i < start[c + 1]; i++)
+                         {
+                             const Run &run = runs[order[i]];
+                             auto [x0, x1] = columns_of(run);
+                             uint8_t *row = &shape.cells[(to_y(run.y) - min_y) * shape.width];
+                             std::fill(row + to_x(x0) - min_x, row + to_x(x1) - min_x + 1, 1);
+                         }
+
+                         keys[c] = shape.key();
+                     } });
+
+    for (auto &type : m_types)
+    {
+        type.count = 0;
+    }
+
+    for (int c = 0; c < components; c++)
+    {
+        int type;
+
+        if (shapes[c].width == 0)
+        {
+            if (m_large < 0)
+            {
+                m_large = m_types.size();
+                m_types.emplace_back();
+            }
+
+            type = m_large;
+        }
+        else if (auto it = m_forms.find(keys[c]); it != m_forms.end())
+        {
+            type = it->second;
+        }
+        else
+        {
+            type = classify(shapes[c]);
+        }
+
+        m_types[type].count++;
+    }
+
+    std::vector<CensusEntry> census;
+
+    for (const auto &type : m_types)
+    {
+        if (type.count)
+        {
+            census.push_back(type);
+        }
+    }
+
+    std::sort(census.begin(), census.end(), [](const CensusEntry &a, const CensusEntry &b)
+              { return a.count != b.count ? a.count > b.count : a.rle < b.rle; });
+
+    return census;
+}
+
+std::string Census::Shape::key() const
+{
+    // The size and then the cells, a bit each
+    const int bytes_per_row = (width + 7) / 8;
+    std::string key(2 + height * bytes_per_row, 0);
+    key[0] = char(width);
+    key[1] = char(height);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (cells[y * width + x])
+            {
+                key[2 + y * bytes_per_row + x / 8] |= char(1 << (x % 8));
+            }
+        }
+    }
+
+    return key;
+}
+
+Census::Shape Census::transform(const Shape &shape, int symmetry)
+{
+    // Bit 0 flips x, bit 1 flips y and bit 2 swaps the axes
+    const bool swap = symmetry & 4;
+    Shape result;
+    result.width = swap ? shape.height : shape.width;
+    result.height = swap ? shape.width : shape.height;
+    result.cells.resize(shape.cells.size());
+
+    for (int y = 0; y < shape.height; y++)
+    {
+        for (int x = 0; x < shape.width; x++)
+        {
+            int tx = symmetry & 1 ? shape.width - 1 - x : x;
+            int ty = symmetry & 2 ? shape.height - 1 - y : y;
+
+            if (swap)
+            {
+                std::swap(tx, ty);
+            }
+
+            result.cells[ty * result.width + tx] = shape.cells[y * shape.width + x];
+        }
+    }
+
+    return result;
+}
+
+std::string Census::Shape::rle() const
+{
+    std::string rle;
+    int empty_rows = 0;
+
+    auto put = [&](int count, char c)
+    {
+        if (count > 1)
+        {
+            rle += std::to_string(count);
+        }
+
+        rle += c;
+    };
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *row = &cells[y * width];
+        int end = width;
+
+        while (end > 0 && !row[end - 1])
+        {
+            end--;
+        }
+
+        if (end == 0)
+        {
+            empty_rows++;
+            continue;
+        }
+
+        if (y > 0)
+        {
+            put(empty_rows + 1, '$');
+        }
+
+        empty_rows = 0;
+
+        for (int x = 0; x < end;)
+        {
+            int run = x;
+
+            while (run < end && row[run] == row[x])
+            {
+                run++;
+            }
+
+            put(run - x, row[x] ? 'o' : 'b');
+            x = run;
+        }
+    }
+
+    return rle + "!";
+}
+
+int Census::classify(const Shape &shape)
+{
+    std::vector<Shape> phases{shape};
+    CensusEntry entry;
+
+    // With B0 the empty space around the object comes alive
+    if (!m_rule.larger_than_life() && !m_rule.generations() && !(m_rule.birth & 1))
+    {
+        // A field large enough for the object to move a cell per generation
+        const int pad = MAX_PERIOD + 2;
+        const int field_width = shape.width + 2 * pad;
+        const int field_height = shape.height + 2 * pad;
+        const uint32_t table = m_rule.table();
+        std::vector<uint8_t> field(field_width * field_height, 0);
+        std::vector<uint8_t> next(field.size(), 0);
+
+        for (int y = 0; y < shape.height; y++)
+        {
+            std::copy_n(&shape.cells[y * shape.width], shape.width, &field[(y + pad) * field_width + pad]);
+        }
+
+        // The live cells of the field, and of the generation before it that
+        // is still in next
+        int box[4] = {pad, pad, pad + shape.width - 1, pad + shape.height - 1};
+        int stale[4] = {box[0], box[1], box[2], box[3]};
+
+        for (int generation = 1; generation <= MAX_PERIOD; generation++)
+        {
+            int min_x = INT_MAX;
+            int min_y = INT_MAX;
+            int max_x = INT_MIN;
+            int max_y = INT_MIN;
+
+            // Nothing moves faster than a cell per generation, and whatever is
+            // left of the older generation in next is overwritten
+            const int x0 = std::min(box[0], stale[0]) - 1;
+            const int y0 = std::min(box[1], stale[1]) - 1;
+            const int x1 = std::max(box[2], stale[2]) + 1;
+            const int y1 = std::max(box[3], stale[3]) + 1;
+
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    const uint8_t *c = &field[y * field_width + x];
+                    int num = c[-field_width - 1] + c[-field_width] + c[-field_width + 1] + c[-1] + c[1] +
+                              c[field_width - 1] + c[field_width] + c[field_width + 1];
+                    uint8_t alive = (table >> (num + 9 * c[0])) & 1;
+                    next[y * field_width + x] = alive;
+
+                    if (alive)
+                    {
+                        min_x = std::min(min_x, x);
+                        max_x = std::max(max_x, x);
+                        min_y = std::min(min_y, y);
+                        max_y = std::max(max_y, y);
+                    }
+                }
+            }
+
+            field.swap(next);
+            std::copy_n(box, 4, stale);
+            box[0] = min_x;
+            box[1] = min_y;
+            box[2] = max_x;
+            box[3] = max_y;
+
+            // Died out or grew up to the edge of the field
+            if (min_x > max_x || min_x <= 1 || min_y <= 1 || max_x >= field_width - 2 || max_y >= field_height - 2 ||
+                max_x - min_x >= MAX_SIZE || max_y - min_y >= MAX_SIZE)
+            {
+                break;
+            }
+
+            Shape phase;
+            phase.width = max_x - min_x + 1;
+            phase.height = max_y - min_y + 1;
+            phase.cells.resize(phase.width * phase.height);
+
+            for (int y = 0; y < phase.height; y++)
+            {
+                std::copy_n(&field[(y + min_y) * field_width + min_x], phase.width, &phase.cells[y * phase.width]);
+            }
+
+            if (phase.width == shape.width && phase.height == shape.height && phase.cells == shape.cells)
+            {
+                entry.period = generation;
+                entry.dx = std::abs(min_x - pad);
+                entry.dy = std::abs(min_y - pad);
+
+                if (entry.dx < entry.dy)
+                {
+                    std::swap(entry.dx, entry.dy);
+                }
+
+                if (entry.dx || entry.dy)
+                {
+                    entry.kind = ObjectKind::Spaceship;
+                }
+                else
+                {
+                    entry.kind = generation == 1 ? ObjectKind::StillLife : ObjectKind::Oscillator;
+                }
+
+                break;
+            }
+
+            phases.push_back(std::move(phase));
+        }
+
+        if (entry.kind == ObjectKind::Other)
+        {
+            entry.period = 0;
+            phases.resize(1);
+        }
+        else if (entry.kind == ObjectKind::StillLife)
+        {
+            entry.period = 0;
+        }
+    }
+
+    // The smallest key over the phases and symmetries names the object
+    std::string best_key;
+    Shape best;
+
+    for (const Shape &phase : phases)
+    {
+        for (int symmetry = 0; symmetry < 8; symmetry++)
+        {
+            Shape form = transform(phase, symmetry);
+            std::string key = form.key();
+
+            if (best_key.empty() || key < best_key)
+            {
+                best_key = key;
+                best = std::move(form);
+            }
+        }
+    }
+
+    int type;
+
+    if (auto it = m_canonical.find(best_key); it != m_canonical.end())
+    {
+        type = it->second;
+    }
+    else
+    {
+        type = m_types.size();
+        entry.rle = best.rle();
+        entry.cells = std::count(best.cells.begin(), best.cells.end(), 1);
+        m_canonical.emplace(best_key, type);
+        m_types.push_back(entry);
+    }
+
+    // Every phase in every orientation is found directly from now on
+    for (const Shape &phase : phases)
+    {
+        for (int symmetry = 0; symmetry < 8; symmetry++)
+        {
+            m_forms.emplace(transform(phase, symmetry).key(), type);
+        }
+    }
+
+    return type;
+}
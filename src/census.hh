@@ -0,0 +1,112 @@
+#pragma once
+
+#include "barrier.hh"
+#include "game.hh"
+#include "pattern.hh"
+#include "rule.hh"
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum class ObjectKind
+{
+    StillLife,
+    Oscillator,
+    Spaceship,
+    // Grows, dies, has a period longer than Census::MAX_PERIOD, is too large
+    // or the rule can't be run on its own
+    Other,
+};
+
+const char *object_kind_name(ObjectKind kind);
+
+struct CensusEntry
+{
+    // The object in its canonical phase and orientation, empty for the objects
+    // that are too large to classify. All of those are counted in one entry.
+    std::string rle;
+    ObjectKind kind = ObjectKind::Other;
+    int cells = 0;
+    // Oscillators and spaceships only
+    int period = 0;
+    // How far a spaceship moves in a period, dx >= dy >= 0
+    int dx = 0;
+    int dy = 0;
+    uint64_t count = 0;
+};
+
+// Tells what is on a board. Live cells at most two cells apart are grouped
+// into objects, with a union-find over the runs of live cells in bands of rows
+// on separate threads and a merge of the rows around the band borders. Every
+// object is then reduced to its canonical form: the smallest one over its
+// phases and the eight rotations and reflections. The first time a form is
+// seen, it is classified by running it on its own.
+//
+// Objects that close to each other, e.g. two blocks with one empty column
+// between them, are counted as one object. The classifications and the threads
+// are kept between boards, so in a batch of boards with the same rule only the
+// new objects cost anything.
+class Census
+{
+public:
+    static constexpr int MAX_PERIOD = 64;
+    // Objects with a larger bounding box are not classified
+    static constexpr int MAX_SIZE = 64;
+
+    // The rule must be a two-state rule with a range of one and without B0 for
+    // objects to be classified, with other rules everything is ObjectKind::Other.
+    Census(const Rule &rule, int threads = 0);
+    ~Census();
+
+    Census(const Census &) = delete;
+    Census &operator=(const Census &) = delete;
+
+    // The objects on the board, most common first. On a torus and a Klein
+    // bottle the objects are followed across the edges. Mirror edges are walls
+    // nothing crosses, like dead ones, and an object touching one is
+    // classified as if it weren't there.
+    std::vector<CensusEntry> take(const Snapshot &snapshot, Boundary boundary);
+
+private:
+    struct Shape
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> cells;
+
+        std::string key() const;
+        std::string rle() const;
+    };
+
+    // Symmetry is one of the eight rotations and reflections
+    static Shape transform(const Shape &shape, int symmetry);
+
+    // Returns the index of the object in m_types
+    int classify(const Shape &shape);
+
+    // Runs job(0) to job(count - 1), count is at most m_threads. The calling
+    // thread runs job(0).
+    void run_parallel(int count, const std::function<void(int)> &job);
+    void pool_thr(int index);
+
+    Rule m_rule;
+    int m_threads;
+
+    // Every form seen, in any phase and orientation, to an index in m_types
+    std::unordered_map<std::string, int> m_forms;
+    std::unordered_map<std::string, int> m_canonical;
+    std::vector<CensusEntry> m_types;
+    // The entry of the objects that are too large, -1 until there is one
+    int m_large{-1};
+
+    // The threads of run_parallel() other than the calling one
+    std::vector<std::thread> m_pool;
+    SpinBarrier<> m_start;
+    SpinBarrier<> m_done;
+    const std::function<void(int)> *m_job{nullptr};
+    int m_job_count{0};
+    bool m_stopping{false};
+};
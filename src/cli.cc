@@ -0,0 +1,336 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+
+#include "common.hh"
+#include "game.hh"
+#include "pattern.hh"
+#include "server.hh"
+#include "bench.hh"
+#include "census.hh"
+#include "session.hh"
+#include "tuner.hh"
+
+using namespace std;
+using chrono::duration_cast;
+using chrono::microseconds;
+
+using Clock = chrono::steady_clock;
+
+static const char *USAGE =
+    "Usage: fast_life_cli [options]\n"
+    "\n"
+    "  --width N              Board width (1024)\n"
+    "  --height N             Board height (1024)\n"
+    "  --generations N        Generations to run (1000)\n"
+    "  --seed N               Seed for the random board\n"
+    "  --pattern FILE         Start from an RLE pattern in the middle of an empty board\n"
+    "  --rule RULE            E.g. B36/S23, B2/S/C3 (Generations) or\n"
+    "                         R5,C0,M1,S34..58,B34..45,NM (Larger than Life),\n"
+    "                         overrides the rule of the pattern\n"
+    "  --boundary NAME        torus, dead, klein or mirror\n"
+    "  --layout NAME          row-major or tiled\n"
+    "  --tile N               Tile size of the tiled layout (64)\n"
+    "  --threads N            Worker threads, one per hardware thread by default\n"
+    "  --tune on|off          Pick the engine by timing the candidates, unless one of\n"
+    "                         the three above is given. The choice is cached. (on)\n"
+    "  --tune-cache FILE      Where the tuning results are cached\n"
+    "  --output FILE          Write the final board as RLE\n"
+    "  --history MB           Keep a rewind history within the budget\n"
+    "  --census N             List the N most common objects on the final board\n"
+    "  --server PATH          Run the headless server on a Unix domain socket\n"
+    "  --pattern-dir DIR      Directory the server's LOADFILE may read from\n"
+    "  --replay FILE          Replay a session recorded in the GUI and time it\n"
+    "  --timings FILE         Write the time of every replayed generation as CSV\n"
+    "  --bench-layout N       Compare the layouts over N generations per board\n";
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::string server_path;
+        std::string pattern_dir;
+        std::string pattern_file;
+        std::string output_file;
+        std::string replay_file;
+        std::string timings_file;
+        std::string rule;
+        std::optional<uint64_t> seed;
+        Boundary boundary = Boundary::Torus;
+        EngineConfig engine;
+        int width = 1024;
+        int height = 1024;
+        int generations = 1000;
+        int bench_generations = 0;
+        size_t history_mb = 0;
+        int census_lines = 0;
+        bool tune = true;
+        // An engine given on the command line is never replaced by tuning
+        bool explicit_engine = false;
+        std::string tune_cache = Tuner::default_cache_path();
+
+        for (int i = 1; i < argc; i += 2)
+        {
+            std::string opt = argv[i];
+
+            if (opt == "--help" || i + 1 >= argc)
+            {
+                cout << USAGE;
+                return opt == "--help" ? 0 : 1;
+            }
+
+            std::string value = argv[i + 1];
+
+            if (opt == "--width")
+            {
+                width = std::stoi(value);
+            }
+            else if (opt == "--height")
+            {
+                height = std::stoi(value);
+            }
+            else if (opt == "--generations")
+            {
+                generations = std::stoi(value);
+            }
+            else if (opt == "--seed")
+            {
+                seed = std::stoull(value);
+            }
+            else if (opt == "--pattern")
+            {
+                pattern_file = value;
+            }
+            else if (opt == "--rule")
+            {
+                rule = value;
+            }
+            else if (opt == "--boundary")
+            {
+                boundary = parse_boundary(value);
+            }
+            else if (opt == "--layout")
+            {
+                engine.layout = parse_layout(value);
+                explicit_engine = true;
+            }
+            else if (opt == "--tile")
+            {
+                engine.tile_size = std::stoi(value);
+                explicit_engine = true;
+            }
+            else if (opt == "--threads")
+            {
+                engine.threads = std::stoi(value);
+                explicit_engine = true;
+            }
+            else if (opt == "--tune")
+            {
+                tune = value == "on";
+            }
+            else if (opt == "--tune-cache")
+            {
+                tune_cache = value;
+            }
+            else if (opt == "--output")
+            {
+                output_file = value;
+            }
+            else if (opt == "--history")
+            {
+                history_mb = std::stoul(value);
+            }
+            else if (opt == "--census")
+            {
+                census_lines = std::stoi(value);
+            }
+            else if (opt == "--server")
+            {
+                server_path = value;
+            }
+            else if (opt == "--pattern-dir")
+            {
+                pattern_dir = value;
+            }
+            else if (opt == "--replay")
+            {
+                replay_file = value;
+            }
+            else if (opt == "--timings")
+            {
+                timings_file = value;
+            }
+            else if (opt == "--bench-layout")
+            {
+                bench_generations = std::stoi(value);
+            }
+            else
+            {
+                throw Error("Unknown option: " + opt);
+            }
+        }
+
+        if (!timings_file.empty() && replay_file.empty())
+        {
+            throw Error("--timings only applies to --replay");
+        }
+
+        if (width <= 0 || height <= 0 || generations < 0)
+        {
+            throw Error("Board size and number of generations must be positive");
+        }
+
+        if (bench_generations > 0)
+        {
+            layout_benchmark(cout, engine.tile_size, bench_generations);
+            return 0;
+        }
+
+        // The session has the engine the board ran with
+        if (!replay_file.empty())
+        {
+            replay_session(cout, replay_file, timings_file);
+            return 0;
+        }
+
+        if (tune && !explicit_engine)
+        {
+            engine = Tuner(tune_cache).tune(width, height, &cout);
+        }
+
+        if (!server_path.empty())
+        {
+            Server server(server_path, width, height, boundary, engine, pattern_dir);
+            server.run();
+            return 0;
+        }
+
+        std::unique_ptr<History> history;
+
+        if (history_mb)
+        {
+            history = std::make_unique<History>(width, height, history_mb << 20);
+        }
+
+        Game game(height, width, boundary, engine, seed);
+        game.set_snapshots(!output_file.empty() || census_lines > 0);
+        game.set_history(history.get());
+
+        std::optional<Pattern> pattern;
+
+        if (!pattern_file.empty())
+        {
+            pattern = Pattern::load(pattern_file);
+
+            if (rule.empty())
+            {
+                rule = pattern->rule;
+            }
+        }
+
+        // Before the pattern, which may have cells in the dying states of the rule
+        if (!rule.empty())
+        {
+            game.set_rule(Rule::parse(rule));
+        }
+
+        if (pattern)
+        {
+            game.clear();
+            game.load(*pattern, std::max(0, (width - pattern->width) / 2), std::max(0, (height - pattern->height) / 2));
+        }
+
+        // Publishes the starting board, edits included. It also gets the page
+        // faults of the first generation out of the way.
+        game.tick();
+        Stats start_stats = game.stats();
+
+        auto start = Clock::now();
+        game.step(generations);
+        double ms = duration_cast<microseconds>(Clock::now() - start).count() / 1000.0;
+
+        Stats stats = game.stats();
+        double per_gen = generations ? ms / generations : 0;
+        double rate = ms > 0 ? double(width) * height * generations / ms / 1000.0 : 0;
+
+        cout << "board        " << width << "x" << height << " " << boundary_name(boundary) << " "
+             << layout_name(engine.layout) << " " << game.threads() << " threads" << endl;
+        cout << "generations  " << generations << endl;
+        cout << fixed << setprecision(3);
+        cout << "time         " << ms << " ms" << endl;
+        cout << "per gen      " << per_gen << " ms" << endl;
+        cout << setprecision(1);
+        cout << "rate         " << rate << " Mcells/s" << endl;
+        cout << "population   " << start_stats.population << " -> " << stats.population << endl;
+
+        if (history)
+        {
+            auto rewind_start = Clock::now();
+            auto rewound = history->reconstruct((history->first() + history->last()) / 2);
+            double rewind_ms = duration_cast<microseconds>(Clock::now() - rewind_start).count() / 1000.0;
+
+            cout << setprecision(3);
+            cout << "history      " << history->first() << "-" << history->last() << ", "
+                 << (history->memory_used() >> 10) << " kB" << endl;
+            cout << "rewind       " << rewind_ms << " ms to generation " << rewound->generation << endl;
+        }
+
+        if (census_lines > 0)
+        {
+            Census census(game.rule(), game.threads());
+            auto census_start = Clock::now();
+            auto objects = census.take(*game.snapshot(), boundary);
+            double census_ms = duration_cast<microseconds>(Clock::now() - census_start).count() / 1000.0;
+
+            uint64_t total = 0;
+
+            for (const auto &object : objects)
+            {
+                total += object.count;
+            }
+
+            cout << setprecision(3);
+            cout << "census       " << total << " objects, " << objects.size() << " kinds in " << census_ms << " ms"
+                 << endl;
+
+            for (size_t i = 0; i < objects.size() && int(i) < census_lines; i++)
+            {
+                const auto &object = objects[i];
+                cout << setw(12) << object.count << " " << setw(10) << object_kind_name(object.kind);
+
+                if (object.kind == ObjectKind::Oscillator || object.kind == ObjectKind::Spaceship)
+                {
+                    cout << " p" << object.period;
+                }
+
+                if (object.kind == ObjectKind::Spaceship)
+                {
+                    cout << " (" << object.dx << "," << object.dy << ")";
+                }
+
+                cout << " " << (object.rle.empty() ? "too large" : object.rle) << endl;
+            }
+        }
+
+        if (!output_file.empty())
+        {
+            std::ofstream out(output_file);
+
+            if (!out)
+            {
+                throw Error("Could not open " + output_file + " for writing");
+            }
+
+            out << to_rle(*game.snapshot(), game.rule());
+        }
+    }
+    catch (const std::exception &err)
+    {
+        cerr << err.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,9 +1,5 @@
 #pragma once
 
-#define SDL_MAIN_HANDLED
-#include <SDL.h>
-#include <SDL_ttf.h>
-
 #include <stdexcept>
 #include <cstdint>
 #include <string>
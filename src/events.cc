@@ -1,33 +1,145 @@
 #include "events.hh"
 
+#include <algorithm>
+
 namespace
 {
     EventGenerator s_event_generator;
+
+    // Merges event into pending if both are part of the same run of motion or
+    // wheel events. The timestamp of the first one is kept.
+    bool coalesce(SDL_Event &pending, const SDL_Event &event)
+    {
+        if (pending.type != event.type)
+        {
+            return false;
+        }
+
+        if (event.type == SDL_MOUSEMOTION && pending.motion.which == event.motion.which &&
+            pending.motion.state == event.motion.state)
+        {
+            pending.motion.x = event.motion.x;
+            pending.motion.y = event.motion.y;
+            pending.motion.xrel += event.motion.xrel;
+            pending.motion.yrel += event.motion.yrel;
+            return true;
+        }
+
+        if (event.type == SDL_MOUSEWHEEL && pending.wheel.which == event.wheel.which &&
+            pending.wheel.direction == event.wheel.direction)
+        {
+            pending.wheel.x += event.wheel.x;
+            pending.wheel.y += event.wheel.y;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool is_input(const SDL_Event &event)
+    {
+        // Keyboard, text input and mouse events
+        return event.type >= SDL_KEYDOWN && event.type < SDL_JOYAXISMOTION;
+    }
+}
+
+// static
+uint32_t EventGenerator::poll()
+{
+    uint32_t oldest_input = 0;
+    SDL_Event pending;
+    SDL_Event event;
+    bool has_pending = false;
+
+    while (SDL_PollEvent(&event))
+    {
+        if (is_input(event) && !oldest_input)
+        {
+            oldest_input = std::max<uint32_t>(event.common.timestamp, 1);
+        }
+
+        if (has_pending && coalesce(pending, event))
+        {
+            continue;
+        }
+
+        if (has_pending)
+        {
+            handle_event(pending);
+        }
+
+        pending = event;
+        has_pending = true;
+    }
+
+    if (has_pending)
+    {
+        handle_event(pending);
+    }
+
+    return oldest_input;
+}
+
+std::vector<EventGenerator::Listener> *EventGenerator::find(uint32_t type)
+{
+    auto it = std::lower_bound(m_listeners.begin(), m_listeners.end(), type, [](const EventListeners &l, uint32_t t)
+                               { return l.type < t; });
+
+    return it != m_listeners.end() && it->type == type ? &it->listeners : nullptr;
 }
 
 // static
 void EventGenerator::handle_event(const SDL_Event &event)
 {
-    for (auto [key, func] : s_event_generator.m_listeners[event.type])
+    auto *listeners = s_event_generator.find(event.type);
+
+    if (!listeners)
+    {
+        return;
+    }
+
+    // Handlers must not add or remove listeners while they run
+    for (const auto &listener : *listeners)
     {
-        func(event);
+        listener.handler(event);
     }
 }
 
 void EventGenerator::add(void *instance, uint32_t event, EventHandler handler)
 {
-    s_event_generator.m_listeners[event].emplace(instance, handler);
+    auto &table = s_event_generator.m_listeners;
+    auto *listeners = s_event_generator.find(event);
+
+    if (!listeners)
+    {
+        auto it = std::lower_bound(table.begin(), table.end(), event, [](const EventListeners &l, uint32_t t)
+                                   { return l.type < t; });
+        listeners = &table.insert(it, {event, {}})->listeners;
+    }
+
+    bool listening = std::any_of(listeners->begin(), listeners->end(), [&](const Listener &l)
+                                 { return l.instance == instance; });
+
+    if (!listening)
+    {
+        listeners->push_back({instance, std::move(handler)});
+    }
 }
 
 void EventGenerator::remove(void *instance)
 {
-    for (auto &[event, handlers] : s_event_generator.m_listeners)
+    for (auto &entry : s_event_generator.m_listeners)
     {
-        handlers.erase(instance);
+        std::erase_if(entry.listeners, [&](const Listener &l)
+                      { return l.instance == instance; });
     }
 }
 
 void EventGenerator::remove(void *instance, uint32_t event)
 {
-    s_event_generator.m_listeners[event].erase(instance);
+    if (auto *listeners = s_event_generator.find(event))
+    {
+        std::erase_if(*listeners, [&](const Listener &l)
+                      { return l.instance == instance; });
+    }
 }
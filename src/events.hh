@@ -1,17 +1,25 @@
 #pragma once
 
 #include "common.hh"
+#include "sdl.hh"
 
-#include <map>
-#include <set>
 #include <cassert>
 #include <functional>
+#include <vector>
 
 using EventHandler = std::function<void(const SDL_Event &)>;
 
 class EventGenerator
 {
 public:
+    // Dispatches everything in the SDL queue. Runs of mouse motion and wheel
+    // events are merged into one event first, so a flooded queue costs one
+    // handler call per run instead of one per event.
+    //
+    // Returns the SDL timestamp of the oldest keyboard or mouse event, or 0 if
+    // there were none.
+    static uint32_t poll();
+
     static void handle_event(const SDL_Event &event);
 
     static void add(void *instance, uint32_t event, EventHandler handler);
@@ -21,7 +29,25 @@ public:
     static void remove(void *instance, uint32_t event);
 
 private:
-    std::map<uint32_t, std::map<void *, EventHandler>> m_listeners;
+    struct Listener
+    {
+        void *instance;
+        EventHandler handler;
+    };
+
+    struct EventListeners
+    {
+        uint32_t type;
+        std::vector<Listener> listeners;
+    };
+
+    // The listeners of a type, null if there are none
+    std::vector<Listener> *find(uint32_t type);
+
+    // Sorted by the event type. There are only a handful of types listened
+    // to, a binary search over them is as fast as indexing a table by the
+    // type and doesn't need a slot for every type below the largest one.
+    std::vector<EventListeners> m_listeners;
 };
 
 template <class Derived>
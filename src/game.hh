@@ -0,0 +1,1544 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "common.hh"
+#include "barrier.hh"
+#include "capture.hh"
+#include "history.hh"
+#include "pattern.hh"
+#include "rule.hh"
+#include "stream.hh"
+
+const int THREADS = std::thread::hardware_concurrency();
+
+// How neighbours are found for cells on the edges of the board
+enum class Boundary
+{
+    Torus,
+    Dead,
+    Klein,
+    Mirror,
+};
+
+inline const char *boundary_name(Boundary boundary)
+{
+    switch (boundary)
+    {
+    case Boundary::Torus:
+        return "torus";
+    case Boundary::Dead:
+        return "dead";
+    case Boundary::Klein:
+        return "klein";
+    case Boundary::Mirror:
+        return "mirror";
+    }
+
+    return "unknown";
+}
+
+// Throws Error if the name is not one returned by boundary_name()
+inline Boundary parse_boundary(const std::string &name)
+{
+    for (Boundary b : {Boundary::Torus, Boundary::Dead, Boundary::Klein, Boundary::Mirror})
+    {
+        if (name == boundary_name(b))
+        {
+            return b;
+        }
+    }
+
+    throw Error("Unknown boundary: " + name);
+}
+
+// Memory layout of the grid
+enum class Layout
+{
+    RowMajor,
+    // Square tiles stored in Z-order, the cells inside a tile are row-major. The
+    // halo is part of the tiled area.
+    Tiled,
+};
+
+inline const char *layout_name(Layout layout)
+{
+    return layout == Layout::Tiled ? "tiled" : "row-major";
+}
+
+// Throws Error if the name is not one returned by layout_name()
+inline Layout parse_layout(const std::string &name)
+{
+    for (Layout l : {Layout::RowMajor, Layout::Tiled})
+    {
+        if (name == layout_name(l))
+        {
+            return l;
+        }
+    }
+
+    throw Error("Unknown layout: " + name);
+}
+
+struct EngineConfig
+{
+    Layout layout = Layout::RowMajor;
+    // Only used with Layout::Tiled, a power of two of at least 8
+    int tile_size = 64;
+    // Worker threads, 0 for one per hardware thread. Never more than there are rows.
+    int threads = 0;
+};
+
+// Statistics gathered by the workers on the pass that builds the packed grid
+struct Stats
+{
+    uint64_t generation = 0;
+    uint64_t population = 0;
+    // Bounding box of the live cells, inclusive. Empty if there are none.
+    int min_x = INT_MAX;
+    int min_y = INT_MAX;
+    int max_x = INT_MIN;
+    int max_y = INT_MIN;
+    uint64_t cells = 0;
+
+    bool empty() const
+    {
+        return population == 0;
+    }
+
+    double density() const
+    {
+        return cells ? double(population) / cells : 0;
+    }
+
+    // Live cells per cell of the bounding box
+    double box_density() const
+    {
+        return empty() ? 0 : double(population) / (double(max_x - min_x + 1) * (max_y - min_y + 1));
+    }
+
+    void add_row(int y, const uint64_t *words, int count)
+    {
+        for (int w = 0; w < count; w++)
+        {
+            if (words[w])
+            {
+                population += std::popcount(words[w]);
+                min_x = std::min(min_x, w * 64 + std::countr_zero(words[w]));
+                max_x = std::max(max_x, w * 64 + 63 - std::countl_zero(words[w]));
+                min_y = std::min(min_y, y);
+                max_y = y;
+            }
+        }
+    }
+
+    void merge(const Stats &other)
+    {
+        population += other.population;
+        min_x = std::min(min_x, other.min_x);
+        min_y = std::min(min_y, other.min_y);
+        max_x = std::max(max_x, other.max_x);
+        max_y = std::max(max_y, other.max_y);
+    }
+};
+
+struct Lifeform
+{
+    Lifeform(bool value)
+        : current(value), next(false)
+    {
+    }
+
+    bool current;
+    bool next;
+};
+
+class Game
+{
+    // Runs exactly once per generation when all workers have finished it and the
+    // main thread has called tick(). Nothing modifies the grid while it runs.
+    struct GenerationDone
+    {
+        Game *game;
+
+        void operator()() noexcept
+        {
+            bool running = game->m_thr_running.load(std::memory_order_relaxed);
+
+            // The phases the destructor runs to stop the workers are not
+            // generations, nothing is published from them
+            if (running)
+            {
+                game->on_generation();
+            }
+
+            // Latched here so that every worker sees the same value in the
+            // phase the main thread stopped in
+            game->m_workers_running = running;
+        }
+    };
+
+public:
+    using Edit = std::function<void()>;
+
+    // The board is filled with random cells. The same seed gives the same board
+    // on every platform, without one a random seed is used.
+    Game(int height, int width, Boundary boundary = Boundary::Torus, EngineConfig engine = {},
+         std::optional<uint64_t> seed = std::nullopt)
+        : m_height(height),
+          m_width(width),
+          m_stride(width + 2),
+          m_words_per_row((width + 63) / 64),
+          m_boundary(boundary),
+          m_engine(engine),
+          m_thread_count(std::clamp(engine.threads > 0 ? engine.threads : THREADS, 1, std::max(height, 1))),
+          m_next_state_barrier(m_thread_count),
+          m_update_barrier(m_thread_count),
+          m_tick_barrier(m_thread_count + 1, GenerationDone{this})
+    {
+        // The grid is surrounded by a one cell halo that holds copies of the cells
+        // on the opposite edges. The kernel never needs to check for the edges.
+        if (m_engine.layout == Layout::Tiled)
+        {
+            init_tiles();
+            m_obj.resize(m_tile_slots.size() << (2 * m_tile_shift), Lifeform(false));
+        }
+        else
+        {
+            m_obj.resize(m_stride * (m_height + 2), Lifeform(false));
+        }
+
+        m_packed.resize(m_words_per_row * m_height);
+        m_changes.resize(m_thread_count);
+        m_row_words.assign(m_thread_count, std::vector<uint64_t>(m_words_per_row));
+        m_partial_stats.resize(m_thread_count);
+
+        // Raw generator output is used one bit per cell, the distributions are
+        // implementation defined
+        std::mt19937_64 gen(seed ? *seed : std::random_device{}());
+
+        for (int y = 0; y < m_height; y++)
+        {
+            for (int x = 0; x < m_width; x += 64)
+            {
+                int count = std::min(64, m_width - x);
+                uint64_t bits = gen() & (~uint64_t(0) >> (64 - count));
+                m_packed[y * m_words_per_row + x / 64] = bits;
+
+                for (int i = 0; i < count; i++)
+                {
+                    m_obj[index(x + i, y)].current = (bits >> i) & 1;
+                }
+            }
+        }
+
+        refresh_halo();
+        recount_stats();
+        publish_stats();
+
+        if (m_engine.layout == Layout::Tiled)
+        {
+            // Bands are made of whole rows of tiles
+            int tile_rows = (m_height + 2 + m_engine.tile_size - 1) / m_engine.tile_size;
+
+            for (int i = 0; i < m_thread_count; i++)
+            {
+                int y_start = std::clamp(i * tile_rows / m_thread_count * m_engine.tile_size - 1, 0, m_height);
+                int y_end = std::clamp((i + 1) * tile_rows / m_thread_count * m_engine.tile_size - 1, 0, m_height);
+
+                if (i == m_thread_count - 1)
+                {
+                    y_end = m_height;
+                }
+
+                m_threads.emplace_back(&Game::update_thr, this, i, y_start, y_end);
+            }
+        }
+        else
+        {
+            int y_size = m_height / m_thread_count;
+
+            for (int i = 0; i < m_thread_count; i++)
+            {
+                int y_start = i * y_size;
+                int y_end = y_start + y_size;
+
+                if (i == m_thread_count - 1)
+                {
+                    y_end += m_height % m_thread_count;
+                    assert(y_end == m_height);
+                }
+
+                m_threads.emplace_back(&Game::update_thr, this, i, y_start, y_end);
+            }
+        }
+    }
+
+    ~Game()
+    {
+        m_thr_running = false;
+        m_tick_barrier.arrive_and_drop();
+
+        for (auto &t : m_threads)
+        {
+            t.join();
+        }
+
+        m_threads.clear();
+
+        m_obj.clear();
+    }
+
+    auto at(int x, int y) const
+    {
+        return m_obj[index(x, y)];
+    }
+
+    // The boundary currently in effect, must be called from the thread that
+    // calls tick()
+    Boundary boundary() const
+    {
+        return m_boundary;
+    }
+
+    void tick()
+    {
+        m_tick_barrier.arrive_and_wait();
+    }
+
+    void step(int generations)
+    {
+        for (int i = 0; i < generations; i++)
+        {
+            tick();
+        }
+    }
+
+    uint64_t generation() const
+    {
+        return m_generation.load(std::memory_order_acquire);
+    }
+
+    int width() const
+    {
+        return m_width;
+    }
+
+    int threads() const
+    {
+        return m_thread_count;
+    }
+
+    const EngineConfig &engine() const
+    {
+        return m_engine;
+    }
+
+    int height() const
+    {
+        return m_height;
+    }
+
+    // The rule currently in effect, must be called from the thread that calls tick()
+    Rule rule() const
+    {
+        return m_rule;
+    }
+
+    // The following modify the board and can be called from any thread. The
+    // changes are applied together on the next generation boundary, so that the
+    // workers never see a partially edited board.
+
+    // Throws Error if the neighbourhood of the rule is larger than the board
+    void set_rule(Rule rule)
+    {
+        if (rule.larger_than_life() && 2 * rule.range + 1 > std::min(m_width, m_height))
+        {
+            throw Error("The range of " + rule.to_string() + " does not fit on the board");
+        }
+
+        post([this, rule]()
+             {
+                 m_rule = rule;
+                 m_rule_table = rule.table();
+
+                 if (rule.larger_than_life())
+                 {
+                     m_row_sums.resize(size_t(m_width) * m_height);
+                     m_window.assign(m_thread_count, std::vector<uint8_t>(m_width + 2 * rule.range));
+                     m_column_sums.assign(m_thread_count, std::vector<uint16_t>(m_width));
+                 }
+
+                 // Cells that were dying under the old rule are dead
+                 m_age_planes = rule.generations() ? std::bit_width(unsigned(rule.states - 1)) : 0;
+                 m_age.assign(m_packed.size() * m_age_planes, 0);
+                 update_dying_colors();
+             });
+    }
+
+    // The Larger than Life workers read the boundary while they compute the
+    // next generation, so it is only changed between generations
+    void set_boundary(Boundary boundary)
+    {
+        post([this, boundary]()
+             { m_boundary = boundary; });
+    }
+
+    // Copies the pattern on the board with its top left corner at x, y. The
+    // pattern wraps around the edges. Dying cells keep their state if the rule
+    // has it, so a Generations rule must be set before the pattern is loaded.
+    void load(const Pattern &pattern, int x, int y)
+    {
+        post([this, pattern, x, y]()
+             {
+                 // A pattern larger than the board is cut off instead of
+                 // wrapping onto itself
+                 int height = std::min(pattern.height, m_height);
+                 int width = std::min(pattern.width, m_width);
+
+                 for (int py = 0; py < height; py++)
+                 {
+                     for (int px = 0; px < width; px++)
+                     {
+                         set((x + px) % m_width, (y + py) % m_height, pattern.state(px, py));
+                     }
+                 }
+             });
+    }
+
+    void clear()
+    {
+        post([this]()
+             {
+                 for (int y = 0; y < m_height; y++)
+                 {
+                     for (int x = 0; x < m_width; x++)
+                     {
+                         set(x, y, 0);
+                     }
+                 }
+             });
+    }
+
+    // Replaces the board with a snapshot of it, e.g. one from History. The
+    // generation counter goes back to that of the snapshot.
+    void restore(std::shared_ptr<const Snapshot> snapshot)
+    {
+        if (snapshot->width != m_width || snapshot->height != m_height)
+        {
+            throw Error("Snapshot does not match the board size");
+        }
+
+        post([this, snapshot]()
+             {
+                 m_packed = snapshot->bits;
+
+                 // Snapshots only have the live cells
+                 std::fill(m_age.begin(), m_age.end(), 0);
+
+                 for (int y = 0; y < m_height; y++)
+                 {
+                     for (int x = 0; x < m_width; x++)
+                     {
+                         m_obj[index(x, y)].current = snapshot->alive(x, y);
+                     }
+                 }
+
+                 m_generation.store(snapshot->generation, std::memory_order_release);
+             });
+    }
+
+    // Statistics of the latest generation. Can be called from any thread.
+    Stats stats() const
+    {
+        std::lock_guard guard(m_snapshot_lock);
+        return m_stats;
+    }
+
+    // Publishes a copy of the board on every generation boundary. Must be
+    // called from the thread that calls tick().
+    void set_snapshots(bool enabled)
+    {
+        m_snapshots = enabled;
+    }
+
+    // The board as it was on the latest generation boundary, or null if
+    // snapshots are not enabled. Can be called from any thread.
+    std::shared_ptr<const Snapshot> snapshot() const
+    {
+        std::lock_guard guard(m_snapshot_lock);
+        return m_snapshot;
+    }
+
+    // Must be called from the thread that calls tick(), the capture is then
+    // guaranteed not to be in use by the workers.
+    void set_capture(FrameCapture *capture)
+    {
+        m_capture = capture;
+    }
+
+    // Same rules as with set_capture()
+    void set_stream(DeltaStream *stream)
+    {
+        m_stream = stream;
+
+        if (m_stream)
+        {
+            // Changes are only tracked from the next generation onwards
+            m_stream->invalidate();
+        }
+    }
+
+    // Same rules as with set_capture(). Every generation from the next one
+    // onwards is recorded.
+    void set_history(History *history)
+    {
+        m_history = history;
+    }
+
+    // Has the workers draw their own rows as RGB332 pixels, one byte per cell,
+    // on the same pass that packs them. Must be called from the thread that
+    // calls tick().
+    void set_pixels(bool enabled)
+    {
+        // Never freed, the workers may still be drawing the current generation
+        if (enabled && m_pixel_buffers[0].empty())
+        {
+            for (auto &buffer : m_pixel_buffers)
+            {
+                buffer.resize(size_t(m_width) * m_height);
+            }
+        }
+
+        m_pixels = enabled;
+    }
+
+    // Takes effect on the next generation boundary
+    void set_palette(uint8_t alive, uint8_t dead)
+    {
+        post([this, alive, dead]()
+             {
+                 m_alive_color = alive;
+                 m_dead_color = dead;
+                 update_dying_colors();
+             });
+    }
+
+    // Keeps a count per cell of how often it has changed lately, which is drawn
+    // over the dead cells of the pixels. Takes effect on the next generation
+    // boundary, the counts start from zero.
+    void set_heat(bool enabled)
+    {
+        post([this, enabled]()
+             {
+                 m_heat_enabled = enabled;
+                 m_heat.assign(enabled ? size_t(m_width) * m_height : 0, 0);
+             });
+    }
+
+    // The pixels of the latest generation, width bytes per row, or null if they
+    // are not enabled. Valid until the next tick() and must be called from the
+    // thread that calls it: the workers draw the next generation into the
+    // other buffer in the meantime.
+    const uint8_t *pixels() const
+    {
+        return m_pixels_ready ? m_pixel_buffers[m_front_pixels].data() : nullptr;
+    }
+
+    void calculate_next_state(int y_start, int y_end)
+    {
+        if (m_engine.layout == Layout::Tiled)
+        {
+            calculate_tiles(y_start, y_end);
+        }
+        else
+        {
+            for (int y = y_start; y < y_end; y++)
+            {
+                calculate_segment(y, 0, m_width);
+            }
+        }
+    }
+
+    // Computes the cells [x_start, x_end) of row y. The cells and their
+    // neighbours on the three rows must be contiguous in memory.
+    void calculate_segment(int y, int x_start, int x_end)
+    {
+        const Lifeform *up = &m_obj[index(x_start, y - 1)];
+        const Lifeform *down = &m_obj[index(x_start, y + 1)];
+        Lifeform *row = &m_obj[index(x_start, y)];
+
+        for (int x = 0; x < x_end - x_start; x++)
+        {
+            int num = up[x - 1].current + up[x].current + up[x + 1].current +
+                      row[x - 1].current + row[x + 1].current +
+                      down[x - 1].current + down[x].current + down[x + 1].current;
+
+            row[x].next = (m_rule_table >> (num + 9 * row[x].current)) & 1;
+        }
+    }
+
+    // Computes a cell whose neighbours may be in other tiles
+    void calculate_cell(int x, int y)
+    {
+        int num = m_obj[index(x - 1, y - 1)].current + m_obj[index(x, y - 1)].current +
+                  m_obj[index(x + 1, y - 1)].current + m_obj[index(x - 1, y)].current +
+                  m_obj[index(x + 1, y)].current + m_obj[index(x - 1, y + 1)].current +
+                  m_obj[index(x, y + 1)].current + m_obj[index(x + 1, y + 1)].current;
+
+        auto &o = m_obj[index(x, y)];
+        o.next = (m_rule_table >> (num + 9 * o.current)) & 1;
+    }
+
+    void calculate_tiles(int y_start, int y_end)
+    {
+        const int tile = m_engine.tile_size;
+
+        for (int y0 = y_start; y0 < y_end;)
+        {
+            int y1 = std::min(y_end, ((y0 + 1) / tile + 1) * tile - 1);
+
+            for (int x0 = 0; x0 < m_width;)
+            {
+                int x1 = std::min(m_width, ((x0 + 1) / tile + 1) * tile - 1);
+
+                // Only the first and last cell of a tile row have neighbours in
+                // the tiles to the left and right
+                for (int y = y0; y < y1; y++)
+                {
+                    calculate_cell(x0, y);
+
+                    if (x1 - x0 > 2)
+                    {
+                        calculate_segment(y, x0 + 1, x1 - 1);
+                    }
+
+                    if (x1 - x0 > 1)
+                    {
+                        calculate_cell(x1 - 1, y);
+                    }
+                }
+
+                x0 = x1;
+            }
+
+            y0 = y1;
+        }
+    }
+
+    // Larger than Life, first pass: the horizontal sums of the cells within the
+    // range, for each cell of the rows. Sliding the window along the row costs
+    // an addition and a subtraction per cell whatever the range is.
+    void calculate_row_sums(int worker, int y_start, int y_end)
+    {
+        const int r = m_rule.range;
+        uint8_t *window = m_window[worker].data();
+
+        for (int y = y_start; y < y_end; y++)
+        {
+            // The row with r cells from across the boundary on both ends
+            const uint64_t *packed = &m_packed[y * m_words_per_row];
+
+            for (int x = 0; x < m_width; x++)
+            {
+                window[x + r] = (packed[x / 64] >> (x % 64)) & 1;
+            }
+
+            for (int i = 0; i < r; i++)
+            {
+                window[i] = source_cell(i - r, y);
+                window[m_width + r + i] = source_cell(m_width + i, y);
+            }
+
+            uint8_t *sums = &m_row_sums[size_t(y) * m_width];
+            int sum = 0;
+
+            for (int i = 0; i < 2 * r + 1; i++)
+            {
+                sum += window[i];
+            }
+
+            sums[0] = sum;
+
+            for (int x = 1; x < m_width; x++)
+            {
+                sum += window[x + 2 * r] - window[x - 1];
+                sums[x] = sum;
+            }
+        }
+    }
+
+    // Larger than Life, second pass: slides a window of 2 * range + 1 row sums
+    // down the band to get the neighbourhood counts. Only reads what the first
+    // pass wrote, so the band can be updated as it goes.
+    void calculate_column_sums(int worker, int y_start, int y_end)
+    {
+        if (y_start == y_end)
+        {
+            return;
+        }
+
+        const int r = m_rule.range;
+        uint16_t *counts = m_column_sums[worker].data();
+        std::fill(counts, counts + m_width, 0);
+
+        for (int dy = -r; dy <= r; dy++)
+        {
+            add_row_sums(counts, y_start + dy, 1);
+        }
+
+        const unsigned birth_min = m_rule.birth_min;
+        const unsigned birth_span = m_rule.birth_max - m_rule.birth_min;
+        const unsigned survival_min = m_rule.survival_min;
+        const unsigned survival_span = m_rule.survival_max - m_rule.survival_min;
+        const bool center = m_rule.center;
+
+        for (int y = y_start; y < y_end; y++)
+        {
+            if (y > y_start)
+            {
+                add_row_sums(counts, y + r, 1);
+                add_row_sums(counts, y - r - 1, -1);
+            }
+
+            for_each_segment(y, [&](int x_start, int x_end, Lifeform *cells)
+                             {
+                                 for (int x = x_start; x < x_end; x++)
+                                 {
+                                     auto &o = cells[x - x_start];
+                                     unsigned count = counts[x] - (center ? 0 : o.current);
+                                     o.next = o.current ? count - survival_min <= survival_span
+                                                        : count - birth_min <= birth_span;
+                                 } });
+        }
+    }
+
+    // Adds the row sums of row y, which may be across the boundary, to counts
+    void add_row_sums(uint16_t *counts, int y, int sign)
+    {
+        // Column 0 comes back as the last column if the row is flipped
+        int x = 0;
+
+        if (!source_cell_position(x, y))
+        {
+            return;
+        }
+
+        const uint8_t *sums = &m_row_sums[size_t(y) * m_width];
+
+        if (x == 0)
+        {
+            for (int i = 0; i < m_width; i++)
+            {
+                counts[i] += sign * sums[i];
+            }
+        }
+        else
+        {
+            // The window is symmetric, so the sums of a flipped row are the
+            // same sums read backwards
+            for (int i = 0; i < m_width; i++)
+            {
+                counts[i] += sign * sums[m_width - 1 - i];
+            }
+        }
+    }
+
+    // Calls func(x_start, x_end, cells) for each contiguous part of row y
+    template <class Func>
+    void for_each_segment(int y, Func func)
+    {
+        if (m_engine.layout == Layout::Tiled)
+        {
+            const int tile = m_engine.tile_size;
+
+            for (int x0 = 0; x0 < m_width;)
+            {
+                int x1 = std::min(m_width, ((x0 + 1) / tile + 1) * tile - 1);
+                func(x0, x1, &m_obj[index(x0, y)]);
+                x0 = x1;
+            }
+        }
+        else
+        {
+            func(0, m_width, &m_obj[index(0, y)]);
+        }
+    }
+
+    void update_state(int worker, int y_start, int y_end)
+    {
+        auto *changes = m_track_changes ? &m_changes[worker] : nullptr;
+        uint8_t *pixels = m_draw_pixels ? m_pixel_buffers[m_front_pixels ^ 1].data() : nullptr;
+        std::vector<uint64_t> &words = m_row_words[worker];
+        Stats &stats = m_partial_stats[worker];
+        stats = Stats{};
+
+        if (changes)
+        {
+            changes->clear();
+        }
+
+        for (int y = y_start; y < y_end; y++)
+        {
+            // The packed copy of the row is built on the same pass
+            std::fill(words.begin(), words.end(), 0);
+
+            for_each_segment(y, [&](int x_start, int x_end, Lifeform *cells)
+                             {
+                                 for (int x = x_start; x < x_end;)
+                                 {
+                                     int end = std::min(x_end, (x / 64 + 1) * 64);
+                                     uint64_t bits = 0;
+
+                                     for (; x < end; x++)
+                                     {
+                                         auto &o = cells[x - x_start];
+                                         o.current = o.next;
+                                         bits |= uint64_t(o.next) << (x % 64);
+                                     }
+
+                                     words[(end - 1) / 64] |= bits;
+                                 } });
+
+            uint64_t *packed = &m_packed[y * m_words_per_row];
+
+            if (m_age_planes)
+            {
+                age_row(y, packed, words.data());
+            }
+
+            if (m_heat_enabled)
+            {
+                update_heat(y, packed, words.data());
+            }
+            stats.add_row(y, words.data(), m_words_per_row);
+
+            if (pixels)
+            {
+                draw_row(y, words.data(), pixels + size_t(y) * m_width);
+            }
+
+            for (int w = 0; w < m_words_per_row; w++)
+            {
+                if (changes && packed[w] != words[w])
+                {
+                    changes->push_back({uint32_t(y * m_words_per_row + w), words[w]});
+                }
+
+                packed[w] = words[w];
+            }
+        }
+    }
+
+    // Spreads the eight bits of a byte to the lowest bit of the eight bytes of a
+    // word: the byte is copied to every byte, byte i keeps only bit i and adding
+    // 0x80 - (1 << i) carries it to the top of the byte.
+    static uint64_t spread_bits(uint64_t bits)
+    {
+        const uint64_t ones = 0x0101010101010101;
+        return (((bits * ones) & 0x8040201008040201) + 0x00406070787c7e7f) >> 7 & ones;
+    }
+
+    // Expands a packed row to one palette byte per cell, eight cells at a time
+    void draw_row(int y, const uint64_t *words, uint8_t *out) const
+    {
+        const uint64_t ones = 0x0101010101010101;
+        uint64_t dead = m_dead_color * ones;
+        uint64_t flip = (m_alive_color ^ m_dead_color) * ones;
+        int x = 0;
+
+        if constexpr (std::endian::native == std::endian::little)
+        {
+            for (; x + 8 <= m_width; x += 8)
+            {
+                uint64_t mask = spread_bits((words[x / 64] >> (x % 64)) & 0xff) * 0xff;
+                uint64_t value = dead ^ (flip & mask);
+                std::memcpy(out + x, &value, sizeof(value));
+            }
+        }
+
+        for (; x < m_width; x++)
+        {
+            out[x] = (words[x / 64] >> (x % 64)) & 1 ? m_alive_color : m_dead_color;
+        }
+
+        if (m_heat_enabled)
+        {
+            draw_heat(y, words, out);
+        }
+
+        // Dying cells are few enough to be drawn one by one
+        for (int w = 0; m_age_planes && w < m_words_per_row; w++)
+        {
+            const uint64_t *age = &m_age[(size_t(y) * m_words_per_row + w) * m_age_planes];
+            uint64_t dying = 0;
+
+            for (int p = 0; p < m_age_planes; p++)
+            {
+                dying |= age[p];
+            }
+
+            for (; dying; dying &= dying - 1)
+            {
+                int bit = std::countr_zero(dying);
+                unsigned value = 0;
+
+                for (int p = 0; p < m_age_planes; p++)
+                {
+                    value |= ((age[p] >> bit) & 1) << p;
+                }
+
+                out[w * 64 + bit] = m_dying_colors[value - 1];
+            }
+        }
+    }
+
+    // Decays the activity of the cells of a row and adds HEAT_STEP to the ones
+    // that changed, saturating at 255. Eight cells at a time.
+    void update_heat(int y, const uint64_t *old, const uint64_t *words)
+    {
+        const uint64_t ones = 0x0101010101010101;
+        const uint64_t high = 0x8080808080808080;
+        uint8_t *heat = &m_heat[size_t(y) * m_width];
+        int x = 0;
+
+        if constexpr (std::endian::native == std::endian::little)
+        {
+            for (; x + 8 <= m_width; x += 8)
+            {
+                uint64_t changed = ((old[x / 64] ^ words[x / 64]) >> (x % 64)) & 0xff;
+                uint64_t value;
+                std::memcpy(&value, heat + x, sizeof(value));
+
+                // Most of a quiet board
+                if (!(value | changed))
+                {
+                    continue;
+                }
+
+                // Masked, the shift can't move bits between the bytes
+                value -= (value >> HEAT_DECAY) & ((0xff >> HEAT_DECAY) * ones);
+
+                // The low seven bits are added without a carry out of the byte,
+                // the carry out of the top bit saturates it
+                uint64_t add = spread_bits(changed) * HEAT_STEP;
+                uint64_t low = (value & ~high) + (add & ~high);
+                uint64_t carry = ((value & add) | ((value | add) & low)) & high;
+                value = (low ^ ((value ^ add) & high)) | (carry >> 7) * 0xff;
+
+                std::memcpy(heat + x, &value, sizeof(value));
+            }
+        }
+
+        for (; x < m_width; x++)
+        {
+            int value = heat[x] - (heat[x] >> HEAT_DECAY);
+
+            if (((old[x / 64] ^ words[x / 64]) >> (x % 64)) & 1)
+            {
+                value = std::min(value + HEAT_STEP, 255);
+            }
+
+            heat[x] = value;
+        }
+    }
+
+    // Dead cells that were recently active are drawn with the heat colours
+    void draw_heat(int y, const uint64_t *words, uint8_t *out) const
+    {
+        static const auto colors = heat_colors();
+        const uint8_t *heat = &m_heat[size_t(y) * m_width];
+
+        for (int x = 0; x < m_width; x += 8)
+        {
+            const int end = std::min(x + 8, m_width);
+            uint64_t value = 0;
+            std::memcpy(&value, heat + x, end - x);
+
+            if (!value)
+            {
+                continue;
+            }
+
+            // x is a multiple of eight, the byte doesn't cross a word
+            uint64_t alive = (words[x / 64] >> (x % 64)) & 0xff;
+
+            if (std::endian::native == std::endian::little && end - x == 8)
+            {
+                // The bytes of at least HEAT_MIN that are not alive
+                const uint64_t high = 0x8080808080808080;
+                uint64_t above = value & uint64_t(0x100 - HEAT_MIN) * 0x0101010101010101;
+                uint64_t hot = ((((above & ~high) + ~high) | above) & high) >> 7;
+                uint64_t mask = (hot & ~spread_bits(alive)) * 0xff;
+
+                if (!mask)
+                {
+                    continue;
+                }
+
+                uint64_t color = 0;
+
+                for (int i = 0; i < 8; i++)
+                {
+                    color |= uint64_t(colors[heat[x + i]]) << (8 * i);
+                }
+
+                uint64_t pixels;
+                std::memcpy(&pixels, out + x, sizeof(pixels));
+                pixels = (pixels & ~mask) | (color & mask);
+                std::memcpy(out + x, &pixels, sizeof(pixels));
+                continue;
+            }
+
+            for (int cell = x; cell < end; cell++)
+            {
+                if (heat[cell] >= HEAT_MIN && !((alive >> (cell - x)) & 1))
+                {
+                    out[cell] = colors[heat[cell]];
+                }
+            }
+        }
+    }
+
+    // Dark red through yellow to white, in RGB332
+    static std::array<uint8_t, 256> heat_colors()
+    {
+        std::array<uint8_t, 256> colors;
+
+        for (int heat = 0; heat < 256; heat++)
+        {
+            int r = std::min(255, 3 * heat);
+            int g = std::clamp(3 * heat - 255, 0, 255);
+            int b = std::clamp(3 * heat - 510, 0, 255);
+            colors[heat] = (r >> 5) << 5 | (g >> 5) << 2 | b >> 6;
+        }
+
+        return colors;
+    }
+
+    // Generations: advances the ages of the dying cells of a row and takes the
+    // births on them out of the new words, the kernel saw them as dead. old is
+    // the row as it was. Only bitwise operations on whole words, a dying cell
+    // of state s has age s - 1 and the planes are its bits.
+    void age_row(int y, const uint64_t *old, uint64_t *words)
+    {
+        const unsigned last = m_rule.states - 1;
+
+        for (int w = 0; w < m_words_per_row; w++)
+        {
+            uint64_t *age = &m_age[(size_t(y) * m_words_per_row + w) * m_age_planes];
+            uint64_t dying = 0;
+
+            for (int p = 0; p < m_age_planes; p++)
+            {
+                dying |= age[p];
+            }
+
+            // Add one to the dying cells, the carry ripples through the planes
+            uint64_t carry = dying;
+
+            for (int p = 0; p < m_age_planes; p++)
+            {
+                uint64_t bit = age[p];
+                age[p] = bit ^ carry;
+                carry &= bit;
+            }
+
+            // The ones that went past the last state are dead
+            uint64_t dead = dying;
+
+            for (int p = 0; p < m_age_planes; p++)
+            {
+                dead &= (last >> p) & 1 ? age[p] : ~age[p];
+            }
+
+            for (int p = 0; p < m_age_planes; p++)
+            {
+                age[p] &= ~dead;
+            }
+
+            // Live cells that didn't survive start dying
+            age[0] |= old[w] & ~words[w];
+
+            uint64_t blocked = words[w] & dying;
+            words[w] &= ~blocked;
+
+            for (; blocked; blocked &= blocked - 1)
+            {
+                m_obj[index(w * 64 + std::countr_zero(blocked), y)].current = false;
+            }
+        }
+    }
+
+    // The dying states fade from the live colour to the dead one
+    void update_dying_colors()
+    {
+        const int steps = m_rule.states - 1;
+        m_dying_colors.resize(std::max(m_rule.states - 2, 0));
+
+        for (size_t i = 0; i < m_dying_colors.size(); i++)
+        {
+            int age = i + 1;
+
+            // RGB332 is mixed one channel at a time
+            auto mix = [&](int shift, int mask)
+            {
+                int alive = (m_alive_color >> shift) & mask;
+                int dead = (m_dead_color >> shift) & mask;
+                return (alive + (dead - alive) * age / steps) << shift;
+            };
+
+            m_dying_colors[i] = mix(5, 7) | mix(2, 7) | mix(0, 3);
+        }
+    }
+
+    // Maps a cell in the halo to the cell on the board it is a copy of. Returns
+    // false if the cell is always dead.
+    template <Boundary B>
+    bool halo_source(int &x, int &y) const
+    {
+        if constexpr (B == Boundary::Dead)
+        {
+            return false;
+        }
+        else if constexpr (B == Boundary::Torus)
+        {
+            x = (x + m_width) % m_width;
+            y = (y + m_height) % m_height;
+        }
+        else if constexpr (B == Boundary::Klein)
+        {
+            // Crossing the top or bottom edge flips the board horizontally
+            if (y < 0 || y >= m_height)
+            {
+                y = (y + m_height) % m_height;
+                x = m_width - 1 - x;
+            }
+
+            x = (x + m_width) % m_width;
+        }
+        else if constexpr (B == Boundary::Mirror)
+        {
+            x = x < 0 ? -x - 1 : x >= m_width ? 2 * m_width - x - 1 : x;
+            y = y < 0 ? -y - 1 : y >= m_height ? 2 * m_height - y - 1 : y;
+        }
+
+        return true;
+    }
+
+    // halo_source() for the current boundary, for cells on the board as well
+    bool source_cell_position(int &x, int &y) const
+    {
+        switch (m_boundary)
+        {
+        case Boundary::Torus:
+            return halo_source<Boundary::Torus>(x, y);
+        case Boundary::Dead:
+            return x >= 0 && x < m_width && y >= 0 && y < m_height;
+        case Boundary::Klein:
+            return halo_source<Boundary::Klein>(x, y);
+        case Boundary::Mirror:
+            return halo_source<Boundary::Mirror>(x, y);
+        }
+
+        return false;
+    }
+
+    // A cell of the packed grid, x and y may be up to a board's size outside of it
+    bool source_cell(int x, int y) const
+    {
+        return source_cell_position(x, y) && (m_packed[y * m_words_per_row + x / 64] >> (x % 64)) & 1;
+    }
+
+    template <Boundary B>
+    void refresh_halo_cell(int x, int y)
+    {
+        int src_x = x;
+        int src_y = y;
+        bool alive = halo_source<B>(src_x, src_y) && m_obj[index(src_x, src_y)].current;
+        m_obj[index(x, y)].current = alive;
+    }
+
+    template <Boundary B>
+    void refresh_halo()
+    {
+        for (int x = -1; x <= m_width; x++)
+        {
+            refresh_halo_cell<B>(x, -1);
+            refresh_halo_cell<B>(x, m_height);
+        }
+
+        for (int y = 0; y < m_height; y++)
+        {
+            refresh_halo_cell<B>(-1, y);
+            refresh_halo_cell<B>(m_width, y);
+        }
+    }
+
+    void refresh_halo()
+    {
+        switch (m_boundary)
+        {
+        case Boundary::Torus:
+            refresh_halo<Boundary::Torus>();
+            break;
+        case Boundary::Dead:
+            refresh_halo<Boundary::Dead>();
+            break;
+        case Boundary::Klein:
+            refresh_halo<Boundary::Klein>();
+            break;
+        case Boundary::Mirror:
+            refresh_halo<Boundary::Mirror>();
+            break;
+        }
+    }
+
+    void post(Edit edit)
+    {
+        std::lock_guard guard(m_edit_lock);
+        m_edits.push_back(std::move(edit));
+    }
+
+    // Only valid while the workers are stopped, i.e. inside edits. State 1 is
+    // alive and states from 2 on are dying, those the rule doesn't have are dead.
+    void set(int x, int y, int state)
+    {
+        bool alive = state == 1;
+        uint64_t &word = m_packed[y * m_words_per_row + x / 64];
+        uint64_t bit = uint64_t(1) << (x % 64);
+        word = alive ? word | bit : word & ~bit;
+        m_obj[index(x, y)].current = alive;
+
+        // A dying cell of state s has age s - 1, see age_row()
+        unsigned age = state >= 2 && state < m_rule.states ? state - 1 : 0;
+
+        for (int p = 0; p < m_age_planes; p++)
+        {
+            uint64_t &plane = m_age[(size_t(y) * m_words_per_row + x / 64) * m_age_planes + p];
+            plane = (age >> p) & 1 ? plane | bit : plane & ~bit;
+        }
+    }
+
+    bool apply_edits()
+    {
+        std::vector<Edit> edits;
+
+        {
+            std::lock_guard guard(m_edit_lock);
+            edits.swap(m_edits);
+        }
+
+        for (auto &edit : edits)
+        {
+            edit();
+        }
+
+        return !edits.empty();
+    }
+
+    // Full scan of the packed grid, only needed when the workers' statistics
+    // don't match the board, i.e. initially and after edits
+    void recount_stats()
+    {
+        for (auto &stats : m_partial_stats)
+        {
+            stats = Stats{};
+        }
+
+        for (int y = 0; y < m_height; y++)
+        {
+            m_partial_stats[0].add_row(y, &m_packed[y * m_words_per_row], m_words_per_row);
+        }
+    }
+
+    void publish_stats()
+    {
+        Stats stats;
+        stats.generation = m_generation;
+        stats.cells = uint64_t(m_width) * m_height;
+
+        for (const auto &partial : m_partial_stats)
+        {
+            stats.merge(partial);
+        }
+
+        std::lock_guard guard(m_snapshot_lock);
+        m_stats = stats;
+    }
+
+    void publish_snapshot()
+    {
+        // Reuse the previous buffer if nobody is holding on to it anymore
+        bool reuse = m_spare_snapshot && m_spare_snapshot.use_count() == 1;
+
+        if (reuse)
+        {
+            // use_count() is a relaxed load, this pairs with the release
+            // decrement of the reader that dropped the buffer last so that
+            // its reads happen before the buffer is overwritten
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        auto snapshot = reuse ? m_spare_snapshot : std::make_shared<Snapshot>();
+        snapshot->generation = m_generation;
+        snapshot->width = m_width;
+        snapshot->height = m_height;
+        snapshot->words_per_row = m_words_per_row;
+        snapshot->bits = m_packed;
+
+        std::lock_guard guard(m_snapshot_lock);
+        m_spare_snapshot = std::move(m_snapshot);
+        m_snapshot = std::move(snapshot);
+    }
+
+    void on_generation()
+    {
+        m_generation.fetch_add(1, std::memory_order_acq_rel);
+        bool edited = apply_edits();
+        refresh_halo();
+
+        if (edited)
+        {
+            recount_stats();
+        }
+
+        publish_stats();
+
+        if (m_snapshots)
+        {
+            publish_snapshot();
+        }
+
+        if (m_capture)
+        {
+            m_capture->offer(m_generation, m_packed.data());
+        }
+
+        if (m_history)
+        {
+            m_history->record(m_generation, m_packed.data());
+        }
+
+        if (m_stream)
+        {
+            if (edited)
+            {
+                m_stream->invalidate();
+            }
+
+            m_stream->publish(m_generation, m_packed.data(), m_changes);
+        }
+
+        if (m_pixels)
+        {
+            // The workers drew this generation into the back buffer, but not
+            // the edits made to it since
+            if (m_draw_pixels)
+            {
+                m_front_pixels ^= 1;
+            }
+
+            if (!m_draw_pixels || edited)
+            {
+                uint8_t *pixels = m_pixel_buffers[m_front_pixels].data();
+
+                for (int y = 0; y < m_height; y++)
+                {
+                    draw_row(y, &m_packed[y * m_words_per_row], pixels + size_t(y) * m_width);
+                }
+            }
+        }
+
+        m_pixels_ready = m_pixels;
+
+        // Read by the workers in the next update_state()
+        m_track_changes = m_stream != nullptr;
+        m_draw_pixels = m_pixels;
+    }
+
+    void update_thr(int worker, int y_start, int y_end)
+    {
+        bool running = true;
+
+        while (running)
+        {
+            m_next_state_barrier.arrive_and_wait();
+
+            if (m_rule.larger_than_life())
+            {
+                calculate_row_sums(worker, y_start, y_end);
+            }
+            else
+            {
+                calculate_next_state(y_start, y_end);
+            }
+
+            m_update_barrier.arrive_and_wait();
+
+            if (m_rule.larger_than_life())
+            {
+                calculate_column_sums(worker, y_start, y_end);
+            }
+
+            update_state(worker, y_start, y_end);
+            m_tick_barrier.arrive_and_wait();
+
+            running = m_workers_running;
+
+            if (!running)
+            {
+                m_next_state_barrier.arrive_and_drop();
+                m_update_barrier.arrive_and_drop();
+                m_tick_barrier.arrive_and_wait();
+            }
+        }
+    }
+
+private:
+    size_t index(int x, int y) const
+    {
+        if (m_engine.layout == Layout::RowMajor)
+        {
+            return (y + 1) * m_stride + x + 1;
+        }
+
+        unsigned px = x + 1;
+        unsigned py = y + 1;
+        size_t tile = m_tile_slots[(py >> m_tile_shift) * m_tiles_x + (px >> m_tile_shift)];
+        return (tile << (2 * m_tile_shift)) + ((py & m_tile_mask) << m_tile_shift) + (px & m_tile_mask);
+    }
+
+    // Orders the tiles by their Morton code so that tiles close to each other on
+    // the board are close to each other in memory
+    void init_tiles()
+    {
+        int tile = m_engine.tile_size;
+
+        if (tile < 8 || (tile & (tile - 1)) != 0)
+        {
+            throw Error("Tile size must be a power of two and at least 8");
+        }
+
+        m_tile_shift = std::countr_zero(unsigned(tile));
+        m_tile_mask = tile - 1;
+        m_tiles_x = (m_width + 2 + tile - 1) / tile;
+        int tiles_y = (m_height + 2 + tile - 1) / tile;
+
+        auto morton = [](uint32_t x, uint32_t y)
+        {
+            uint64_t code = 0;
+
+            for (int i = 0; i < 32; i++)
+            {
+                code |= uint64_t((x >> i) & 1) << (2 * i) | uint64_t((y >> i) & 1) << (2 * i + 1);
+            }
+
+            return code;
+        };
+
+        std::vector<std::pair<uint64_t, uint32_t>> order;
+
+        for (int ty = 0; ty < tiles_y; ty++)
+        {
+            for (int tx = 0; tx < m_tiles_x; tx++)
+            {
+                order.emplace_back(morton(tx, ty), ty * m_tiles_x + tx);
+            }
+        }
+
+        std::sort(order.begin(), order.end());
+        m_tile_slots.resize(order.size());
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            m_tile_slots[order[i].second] = i;
+        }
+    }
+
+    int m_height;
+    int m_width;
+    int m_stride;
+    int m_words_per_row;
+    Boundary m_boundary;
+    EngineConfig m_engine;
+    int m_thread_count;
+    int m_tile_shift{0};
+    unsigned m_tile_mask{0};
+    int m_tiles_x{0};
+    std::vector<uint32_t> m_tile_slots;
+    std::vector<Lifeform> m_obj;
+    std::vector<uint64_t> m_packed;
+    std::atomic<uint64_t> m_generation{0};
+    Rule m_rule;
+    uint32_t m_rule_table{m_rule.table()};
+
+    // Larger than Life: the horizontal sums of every cell, and per worker the
+    // row being summed and the running vertical sums
+    std::vector<uint8_t> m_row_sums;
+    std::vector<std::vector<uint8_t>> m_window;
+    std::vector<std::vector<uint16_t>> m_column_sums;
+
+    // Generations: the ages of the dying cells as bit planes, m_age_planes
+    // words per word of the packed grid
+    int m_age_planes{0};
+    std::vector<uint64_t> m_age;
+    std::vector<uint8_t> m_dying_colors;
+
+    std::mutex m_edit_lock;
+    std::vector<Edit> m_edits;
+
+    bool m_snapshots{false};
+    mutable std::mutex m_snapshot_lock;
+    Stats m_stats;
+    std::vector<Stats> m_partial_stats;
+    std::shared_ptr<Snapshot> m_snapshot;
+    std::shared_ptr<Snapshot> m_spare_snapshot;
+
+    FrameCapture *m_capture{nullptr};
+    DeltaStream *m_stream{nullptr};
+    History *m_history{nullptr};
+    bool m_track_changes{false};
+    std::vector<std::vector<WordChange>> m_changes;
+    std::vector<std::vector<uint64_t>> m_row_words;
+
+    // The front buffer holds the latest generation, the workers draw the next
+    // one into the back buffer
+    bool m_pixels{false};
+    bool m_draw_pixels{false};
+    bool m_pixels_ready{false};
+    int m_front_pixels{0};
+    uint8_t m_alive_color{0x00};
+    uint8_t m_dead_color{0xff};
+    std::vector<uint8_t> m_pixel_buffers[2];
+
+    // Activity: every change adds HEAT_STEP and every generation takes away a
+    // 2^HEAT_DECAY:th, so a cell that keeps changing saturates
+    static constexpr int HEAT_STEP = 32;
+    static constexpr int HEAT_DECAY = 4;
+    // Below this a cell is drawn as just dead
+    static constexpr int HEAT_MIN = 16;
+    bool m_heat_enabled{false};
+    std::vector<uint8_t> m_heat;
+
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_thr_running{true};
+    bool m_workers_running{true};
+
+    SpinBarrier<> m_next_state_barrier;
+    SpinBarrier<> m_update_barrier;
+    SpinBarrier<GenerationDone> m_tick_barrier;
+};
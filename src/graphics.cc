@@ -1,6 +1,7 @@
 #include "graphics.hh"
 
 #include <cassert>
+#include <memory>
 #include <unordered_map>
 
 //
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.hh"
+#include "sdl.hh"
 #include "objects.hh"
 
 struct Color
@@ -0,0 +1,299 @@
+#include "history.hh"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    void put_varint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(value | 0x80);
+            value >>= 7;
+        }
+
+        out.push_back(value);
+    }
+
+    uint64_t get_varint(const uint8_t *&ptr)
+    {
+        uint64_t value = 0;
+
+        for (int shift = 0;; shift += 7)
+        {
+            uint8_t byte = *ptr++;
+            value |= uint64_t(byte & 0x7f) << shift;
+
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+    }
+}
+
+History::History(int width, int height, size_t budget, int keyframe_interval)
+    : m_width(width),
+      m_height(height),
+      m_words_per_row((width + 63) / 64),
+      m_grid_words(size_t(m_words_per_row) * height),
+      m_budget(budget),
+      m_keyframe_interval(std::max(keyframe_interval, 1)),
+      m_latest(m_grid_words),
+      m_xor(m_grid_words)
+{
+}
+
+void History::record(uint64_t generation, const uint64_t *packed)
+{
+    std::lock_guard guard(m_lock);
+    uint64_t last = m_first + m_frames.size() - 1;
+
+    if (!m_frames.empty() && generation != last + 1)
+    {
+        if (generation > m_first && generation <= last)
+        {
+            // Rewound, continue from the generation before this one
+            rebuild(generation - 1 - m_first, m_latest);
+
+            while (m_first + m_frames.size() > generation)
+            {
+                m_bytes -= m_frames.back().data.size();
+                m_frames.pop_back();
+            }
+
+            m_since_keyframe = 0;
+
+            for (size_t i = m_frames.size() - 1; !m_frames[i].keyframe; i--)
+            {
+                m_since_keyframe++;
+            }
+        }
+        else
+        {
+            m_frames.clear();
+            m_bytes = 0;
+        }
+    }
+
+    // A keyframe when over the budget lets evict() drop the older ones
+    bool keyframe = m_frames.empty() || m_since_keyframe + 1 >= m_keyframe_interval || m_bytes > m_budget;
+
+    if (!keyframe)
+    {
+        for (size_t i = 0; i < m_grid_words; i++)
+        {
+            m_xor[i] = packed[i] ^ m_latest[i];
+        }
+
+        encode(m_xor.data(), m_encoded);
+        keyframe = m_encoded.size() >= m_grid_words * sizeof(uint64_t);
+    }
+
+    if (keyframe)
+    {
+        encode(packed, m_encoded);
+    }
+
+    if (m_frames.empty())
+    {
+        m_first = generation;
+    }
+
+    m_frames.push_back(Frame{keyframe, m_encoded});
+    m_bytes += m_encoded.size();
+    m_since_keyframe = keyframe ? 0 : m_since_keyframe + 1;
+    std::copy(packed, packed + m_grid_words, m_latest.begin());
+
+    evict();
+}
+
+std::shared_ptr<Snapshot> History::reconstruct(uint64_t generation) const
+{
+    std::lock_guard guard(m_lock);
+
+    if (m_frames.empty() || generation < m_first || generation >= m_first + m_frames.size())
+    {
+        return nullptr;
+    }
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->generation = generation;
+    snapshot->width = m_width;
+    snapshot->height = m_height;
+    snapshot->words_per_row = m_words_per_row;
+    snapshot->bits.resize(m_grid_words);
+    rebuild(generation - m_first, snapshot->bits);
+    return snapshot;
+}
+
+uint64_t History::first() const
+{
+    std::lock_guard guard(m_lock);
+    return m_frames.empty() ? 0 : m_first;
+}
+
+uint64_t History::last() const
+{
+    std::lock_guard guard(m_lock);
+    return m_frames.empty() ? 0 : m_first + m_frames.size() - 1;
+}
+
+size_t History::memory_used() const
+{
+    std::lock_guard guard(m_lock);
+    return m_bytes;
+}
+
+// A sequence of runs: the number of zero words, the number of literal words
+// and then the literal words. The zero words at the end are implicit. A literal
+// word is a mask of its non-zero bytes followed by those bytes, most words of a
+// delta only have a few cells that changed.
+void History::encode(const uint64_t *words, std::vector<uint8_t> &out) const
+{
+    out.clear();
+    size_t i = 0;
+
+    while (i < m_grid_words)
+    {
+        size_t zeros = 0;
+
+        while (i + zeros < m_grid_words && words[i + zeros] == 0)
+        {
+            zeros++;
+        }
+
+        if (i + zeros == m_grid_words)
+        {
+            break;
+        }
+
+        size_t start = i + zeros;
+        size_t end = start;
+
+        while (end < m_grid_words && words[end] != 0)
+        {
+            end++;
+        }
+
+        put_varint(out, zeros);
+        put_varint(out, end - start);
+
+        for (size_t w = start; w < end; w++)
+        {
+            size_t mask_pos = out.size();
+            uint8_t mask = 0;
+            out.push_back(0);
+
+            for (int b = 0; b < 8; b++)
+            {
+                uint8_t byte = words[w] >> (8 * b);
+
+                if (byte)
+                {
+                    mask |= 1 << b;
+                    out.push_back(byte);
+                }
+            }
+
+            out[mask_pos] = mask;
+        }
+
+        i = end;
+    }
+}
+
+void History::decode(const Frame &frame, std::vector<uint64_t> &grid) const
+{
+    if (frame.keyframe)
+    {
+        std::fill(grid.begin(), grid.end(), 0);
+    }
+
+    const uint8_t *ptr = frame.data.data();
+    const uint8_t *end = ptr + frame.data.size();
+    size_t pos = 0;
+
+    while (ptr < end)
+    {
+        pos += get_varint(ptr);
+        size_t count = get_varint(ptr);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t mask = *ptr++;
+            uint64_t word = 0;
+
+            for (; mask; mask &= mask - 1)
+            {
+                word |= uint64_t(*ptr++) << (8 * std::countr_zero(mask));
+            }
+
+            grid[pos++] ^= word;
+        }
+    }
+}
+
+// Goes forwards from the keyframe before the frame or, if there are no
+// keyframes after it, backwards from the newest grid, whichever is shorter
+void History::rebuild(size_t frame, std::vector<uint64_t> &grid) const
+{
+    size_t keyframe = frame;
+
+    while (!m_frames[keyframe].keyframe)
+    {
+        keyframe--;
+    }
+
+    size_t next_keyframe = frame + 1;
+
+    while (next_keyframe < m_frames.size() && !m_frames[next_keyframe].keyframe)
+    {
+        next_keyframe++;
+    }
+
+    if (next_keyframe == m_frames.size() && m_frames.size() - 1 - frame < frame - keyframe)
+    {
+        grid = m_latest;
+
+        for (size_t i = m_frames.size() - 1; i > frame; i--)
+        {
+            decode(m_frames[i], grid);
+        }
+    }
+    else
+    {
+        for (size_t i = keyframe; i <= frame; i++)
+        {
+            decode(m_frames[i], grid);
+        }
+    }
+}
+
+void History::evict()
+{
+    while (m_bytes > m_budget)
+    {
+        // Only whole keyframe groups can go, the newest one always stays
+        size_t next = 1;
+
+        while (next < m_frames.size() && !m_frames[next].keyframe)
+        {
+            next++;
+        }
+
+        if (next == m_frames.size())
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < next; i++)
+        {
+            m_bytes -= m_frames.front().data.size();
+            m_frames.pop_front();
+        }
+
+        m_first += next;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.hh"
+#include "pattern.hh"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Keeps the recent generations of a board within a memory budget so that they
+// can be stepped back to. Every generation is stored as the XOR of the packed
+// grid with the previous one, with a full keyframe every keyframe_interval
+// generations. Both are compressed by run-length encoding the zero words and
+// storing only the non-zero bytes of the others.
+//
+// When the budget is exceeded the oldest keyframe and its deltas are dropped.
+class History
+{
+public:
+    History(int width, int height, size_t budget, int keyframe_interval = 32);
+
+    // Called once per generation with the packed grid. A generation that was
+    // already recorded means the board was rewound, the generations after it
+    // are discarded. Any other gap starts the history over.
+    void record(uint64_t generation, const uint64_t *packed);
+
+    // Rebuilds the board of the generation, or returns null if it is no longer
+    // held. Can be called from any thread.
+    std::shared_ptr<Snapshot> reconstruct(uint64_t generation) const;
+
+    // The oldest and the newest generation held, both are 0 if there are none
+    uint64_t first() const;
+    uint64_t last() const;
+
+    // Bytes used by the compressed frames
+    size_t memory_used() const;
+
+private:
+    struct Frame
+    {
+        bool keyframe;
+        std::vector<uint8_t> data;
+    };
+
+    void encode(const uint64_t *words, std::vector<uint8_t> &out) const;
+    void decode(const Frame &frame, std::vector<uint64_t> &grid) const;
+    void rebuild(size_t frame, std::vector<uint64_t> &grid) const;
+    void evict();
+
+    int m_width;
+    int m_height;
+    int m_words_per_row;
+    size_t m_grid_words;
+    size_t m_budget;
+    int m_keyframe_interval;
+
+    mutable std::mutex m_lock;
+    std::deque<Frame> m_frames;
+    uint64_t m_first{0};
+    size_t m_bytes{0};
+    int m_since_keyframe{0};
+
+    // The newest grid and scratch space for the XOR with it
+    std::vector<uint64_t> m_latest;
+    std::vector<uint64_t> m_xor;
+    std::vector<uint8_t> m_encoded;
+};
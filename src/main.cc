@@ -11,10 +11,23 @@
 #include <random>
 #include <shared_mutex>
 
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
 #include "common.hh"
 #include "graphics.hh"
 #include "objects.hh"
 #include "events.hh"
+#include "capture.hh"
+#include "stream.hh"
+#include "history.hh"
+#include "tuner.hh"
+#include "game.hh"
+#include "session.hh"
 
 using namespace std;
 using chrono::duration_cast;
@@ -27,6 +40,14 @@ static constexpr int WINDOW_WIDTH = 800;
 static constexpr int WINDOW_HEIGHT = 600;
 static constexpr int FRAMERATE = 120;
 
+// Followed by the process id, every instance streams to its own ring
+static const std::string STREAM_PREFIX = "/fast_life-";
+static const size_t HISTORY_BUDGET = 64 << 20;
+static const int REWIND_STEP = 100;
+
+// Cycled through with g: Life, Brian's Brain and Star Wars
+static const char *RULES[] = {"B3/S23", "B2/S/C3", "B2/S345/C4"};
+
 static const std::string FONT_NAME = "fonts/pixeldroidMenuRegular.ttf";
 static const Color FONT_COLOR = COLOR_WHITE;
 static const int FONT_SIZE = 22;
@@ -37,194 +58,6 @@ const int Y_OFFSET = 20;
 const int X_PAD = 0;
 const int Y_PAD = 0;
 const int OBJ_SIZE = 4;
-const int THREADS = std::thread::hardware_concurrency();
-
-struct Lifeform
-{
-    Lifeform(bool value)
-        : current(value), next(false)
-    {
-    }
-
-    bool current;
-    bool next;
-};
-
-class Game
-{
-public:
-    Game(int height, int width)
-        : m_next_state_barrier(THREADS),
-          m_update_barrier(THREADS),
-          m_tick_barrier(THREADS + 1),
-          m_height(height),
-          m_width(width)
-    {
-        std::random_device rnd;
-        std::mt19937 gen(rnd());
-        std::uniform_int_distribution flip(0, 1);
-
-        for (int y = 0; y < m_height; y++)
-        {
-            for (int x = 0; x < m_width; x++)
-            {
-                m_obj.emplace_back(flip(gen));
-            }
-        }
-
-        int y_size = m_height / THREADS;
-
-        for (int i = 0; i < THREADS; i++)
-        {
-            int y_start = i * y_size;
-            int y_end = y_start + y_size;
-
-            if (i == THREADS - 1)
-            {
-                y_end += m_height % THREADS;
-                assert(y_end == m_height);
-            }
-
-            m_threads.emplace_back(&Game::update_thr, this, y_start, y_end);
-        }
-    }
-
-    ~Game()
-    {
-        m_thr_running = false;
-        m_tick_barrier.arrive_and_drop();
-
-        for (auto &t : m_threads)
-        {
-            t.join();
-        }
-
-        m_threads.clear();
-
-        m_obj.clear();
-    }
-
-    bool alive_at(int x, int y) const
-    {
-        if (x == -1)
-        {
-            x = m_width - 1;
-        }
-        else if (x == m_width)
-        {
-            x = 0;
-        }
-
-        if (y == -1)
-        {
-            y = m_height - 1;
-        }
-        else if (y == m_height)
-        {
-            y = 0;
-        }
-
-        return m_obj[y * m_width + x].current;
-    }
-
-    auto at(int x, int y) const
-    {
-        return m_obj[y * m_width + x];
-    }
-
-    void tick()
-    {
-        m_tick_barrier.arrive_and_wait();
-    }
-
-    void set_alive_at(int x, int y)
-    {
-        assert(x >= 0 && x < m_width);
-        assert(y >= 0 && y < m_height);
-        int num = 0;
-        num += alive_at(x - 1, y - 1);
-        num += alive_at(x, y - 1);
-        num += alive_at(x + 1, y - 1);
-        num += alive_at(x + 1, y);
-        num += alive_at(x + 1, y + 1);
-        num += alive_at(x, y + 1);
-        num += alive_at(x - 1, y + 1);
-        num += alive_at(x - 1, y);
-
-        auto &o = m_obj[y * m_width + x];
-
-        if (o.current)
-        {
-            if (num != 3 && num != 2)
-            {
-                o.next = false;
-            }
-        }
-        else if (num == 3)
-        {
-            o.next = true;
-        }
-    }
-
-    void calculate_next_state(int y_start, int y_end)
-    {
-        for (int y = y_start; y < y_end; y++)
-        {
-            for (int x = 0; x < m_width; x++)
-            {
-                set_alive_at(x, y);
-            }
-        }
-    }
-
-    void update_state(int y_start, int y_end)
-    {
-        for (int y = y_start; y < y_end; y++)
-        {
-            for (int x = 0; x < m_width; x++)
-            {
-                auto &o = m_obj[y * m_width + x];
-                o.current = o.next;
-            }
-        }
-    }
-
-    void update_thr(int y_start, int y_end)
-    {
-        bool running = true;
-
-        while (running)
-        {
-            auto now = Clock::now();
-            m_next_state_barrier.arrive_and_wait();
-            calculate_next_state(y_start, y_end);
-            m_update_barrier.arrive_and_wait();
-            update_state(y_start, y_end);
-            m_tick_barrier.arrive_and_wait();
-
-            running = m_thr_running.load(std::memory_order_relaxed);
-
-            if (!running)
-            {
-                m_next_state_barrier.arrive_and_drop();
-                m_update_barrier.arrive_and_drop();
-                m_tick_barrier.arrive_and_wait();
-            }
-        }
-    }
-
-private:
-    int m_height;
-    int m_width;
-    std::vector<Lifeform> m_obj;
-
-    std::vector<std::thread> m_threads;
-    std::atomic<bool> m_thr_running{true};
-
-    std::barrier<> m_next_state_barrier;
-    std::barrier<> m_update_barrier;
-    std::barrier<> m_tick_barrier;
-};
 
 class Program
 {
@@ -264,13 +97,32 @@ public:
         add_text("b: Increase tile size");
         add_text("v: Decrease tile size");
         add_text("r: Randomize colors");
+        add_text("m: Change boundary");
+        add_text("l: Change layout (auto, row-major, tiled)");
         add_text("x: Reinitialize game");
+        add_text("p: Record video (Y4M)");
+        add_text("o: Record PNG frames");
+        add_text("s: Stream deltas to shared memory");
+        add_text("Backspace: Rewind 100 generations");
+        add_text("t: Record the session, replay with --replay");
         add_text("Esc: Exit game");
 
         add_variable_text("Width: ", &m_width_str);
         add_variable_text("Height: ", &m_height_str);
         add_variable_text("Speed: ", &m_speed_str);
         add_variable_text("Size: ", &m_size_str);
+        add_variable_text("Boundary: ", &m_boundary_str);
+        add_variable_text("Layout: ", &m_layout_str);
+        add_variable_text("Rule: ", &m_rule_str);
+        add_variable_text("Generation: ", &m_generation_str);
+        add_variable_text("Population: ", &m_population_str);
+        add_variable_text("Bounding box: ", &m_bbox_str);
+        add_variable_text("Recording: ", &m_capture_str);
+        add_variable_text("Streaming: ", &m_stream_str);
+        add_variable_text("History: ", &m_history_str);
+        add_variable_text("Input latency: ", &m_latency_str);
+        add_variable_text("Heat map: ", &m_heat_str);
+        add_variable_text("Session: ", &m_session_str);
 
         EventGenerator::add(this, SDL_QUIT, [this](const auto &event)
                             { m_running = false; });
@@ -291,6 +143,8 @@ public:
     ~Program()
     {
         // Stop processing and clear out objects before stopping SDL
+        record_end("END");
+        m_session.reset();
         stop();
         m_labels.clear();
         SDL_DestroyTexture(m_texture);
@@ -317,6 +171,7 @@ public:
             if (m_game && now >= next_update)
             {
                 m_game->tick();
+                m_ticks++;
                 next_update = now + update_tick;
             }
 
@@ -338,16 +193,155 @@ public:
 private:
     void stop()
     {
+        record_end("STOP");
         m_game.reset();
+        m_capture.reset();
+        m_stream.reset();
+        m_history.reset();
+    }
+
+    void rewind(int generations)
+    {
+        if (m_game && m_history)
+        {
+            uint64_t generation = m_game->generation();
+            uint64_t target = generation > uint64_t(generations) ? generation - generations : 0;
+
+            target = std::max(target, m_history->first());
+
+            if (auto snapshot = m_history->reconstruct(target))
+            {
+                record("REWIND " + std::to_string(target));
+                m_game->restore(snapshot);
+            }
+        }
+    }
+
+    void toggle_stream()
+    {
+        if (m_game)
+        {
+            m_game->set_stream(nullptr);
+        }
+
+        record("STREAM");
+
+        if (m_stream)
+        {
+            m_stream.reset();
+        }
+        else if (m_game)
+        {
+            try
+            {
+                m_stream = std::make_unique<DeltaStream>(STREAM_PREFIX + std::to_string(getpid()), m_width, m_height);
+                m_game->set_stream(m_stream.get());
+            }
+            catch (const Error &err)
+            {
+                cerr << err.what() << endl;
+            }
+        }
+    }
+
+    void toggle_capture(CaptureFormat format)
+    {
+        bool same_format = m_capture && m_capture->format() == format;
+        record("CAPTURE");
+
+        if (m_game)
+        {
+            m_game->set_capture(nullptr);
+        }
+
+        m_capture.reset();
+
+        if (m_game && !same_format)
+        {
+            auto stamp = duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            std::string path = "capture-" + std::to_string(stamp);
+
+            if (format == CaptureFormat::Y4M)
+            {
+                path += ".y4m";
+            }
+
+            m_capture = std::make_unique<FrameCapture>(format, path, m_width, m_height);
+            m_capture->set_palette(m_alive_color, m_dead_color);
+            m_game->set_capture(m_capture.get());
+        }
     }
 
     void reinitialize()
     {
-        m_game = std::make_unique<Game>(m_height, m_width);
+        stop();
+        // Tuning a new board size takes a fraction of a second, after that it
+        // comes from the cache
+        EngineConfig engine = m_autotune ? m_tuner.tune(m_width, m_height) : EngineConfig{m_layout};
+        uint64_t seed = uint64_t(m_random()) << 32 | m_random();
+        m_game = std::make_unique<Game>(m_height, m_width, m_boundary, engine, seed);
+        m_ticks = 0;
+        update_layout_text();
+        m_history = std::make_unique<History>(m_width, m_height, HISTORY_BUDGET);
+        m_game->set_history(m_history.get());
+        m_game->set_rule(Rule::parse(RULES[m_rule]));
+        m_game->set_pixels(true);
+        m_game->set_heat(m_heat);
+        m_game->set_palette(m_alive_color, m_dead_color);
+
+        SessionStart start;
+        start.width = m_width;
+        start.height = m_height;
+        start.seed = seed;
+        start.boundary = m_boundary;
+        start.engine = m_game->engine();
+        start.engine.threads = m_game->threads();
+        start.rule = RULES[m_rule];
+        start.history = HISTORY_BUDGET;
+        start.pixels = true;
+        record("START " + start.to_string());
+        record("PALETTE " + std::to_string(m_alive_color) + " " + std::to_string(m_dead_color));
+        record(std::string("HEAT ") + (m_heat ? "on" : "off"));
+
         SDL_DestroyTexture(m_texture);
         m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STREAMING, m_width, m_height);
     }
 
+    // A new session starts with a new board
+    void toggle_session()
+    {
+        if (m_session)
+        {
+            record_end("END");
+            m_session.reset();
+        }
+        else
+        {
+            stop();
+            auto stamp = duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+            m_session = std::make_unique<SessionRecorder>("session-" + std::to_string(stamp) + ".txt");
+            reinitialize();
+        }
+    }
+
+    // Commands given to the board, if the session is recorded
+    void record(const std::string &command)
+    {
+        if (m_session && m_game)
+        {
+            m_session->record(m_ticks, m_game->generation(), command);
+        }
+    }
+
+    // With the population the replay must end up with
+    void record_end(const std::string &command)
+    {
+        if (m_game)
+        {
+            record(command + " " + std::to_string(m_game->stats().population));
+        }
+    }
+
     void clear_all_text()
     {
         m_labels.clear();
@@ -401,18 +395,99 @@ private:
 
         case SDLK_c:
             m_speed++;
+            record("SPEED " + std::to_string(m_speed));
             break;
 
         case SDLK_z:
             if (m_speed > 1)
             {
                 m_speed--;
+                record("SPEED " + std::to_string(m_speed));
             }
             break;
 
         case SDLK_r:
             m_alive_color = rand() % 256;
             m_dead_color = rand() % 256;
+
+            if (m_game)
+            {
+                m_game->set_palette(m_alive_color, m_dead_color);
+                record("PALETTE " + std::to_string(m_alive_color) + " " + std::to_string(m_dead_color));
+            }
+
+            if (m_capture)
+            {
+                m_capture->set_palette(m_alive_color, m_dead_color);
+            }
+            break;
+
+        case SDLK_m:
+            m_boundary = Boundary((int(m_boundary) + 1) % 4);
+
+            if (m_game)
+            {
+                m_game->set_boundary(m_boundary);
+                record(std::string("BOUNDARY ") + boundary_name(m_boundary));
+            }
+            break;
+
+        case SDLK_g:
+            m_rule = (m_rule + 1) % std::size(RULES);
+
+            if (m_game)
+            {
+                m_game->set_rule(Rule::parse(RULES[m_rule]));
+                record(std::string("RULE ") + RULES[m_rule]);
+            }
+            break;
+
+        case SDLK_h:
+            m_heat = !m_heat;
+
+            if (m_game)
+            {
+                m_game->set_heat(m_heat);
+                record(std::string("HEAT ") + (m_heat ? "on" : "off"));
+            }
+            break;
+
+        case SDLK_l:
+            if (m_autotune)
+            {
+                m_autotune = false;
+                m_layout = Layout::RowMajor;
+            }
+            else if (m_layout == Layout::RowMajor)
+            {
+                m_layout = Layout::Tiled;
+            }
+            else
+            {
+                m_autotune = true;
+            }
+
+            stop();
+            break;
+
+        case SDLK_p:
+            toggle_capture(CaptureFormat::Y4M);
+            break;
+
+        case SDLK_o:
+            toggle_capture(CaptureFormat::PNG);
+            break;
+
+        case SDLK_s:
+            toggle_stream();
+            break;
+
+        case SDLK_BACKSPACE:
+            rewind(REWIND_STEP);
+            break;
+
+        case SDLK_t:
+            toggle_session();
             break;
 
         case SDLK_b:
@@ -463,6 +538,10 @@ private:
         m_height_str = std::to_string(m_height);
         m_speed_str = std::to_string(m_speed);
         m_size_str = std::to_string(m_size);
+        m_boundary_str = boundary_name(m_boundary);
+        m_rule_str = RULES[m_rule];
+        m_heat_str = m_heat ? "on" : "off";
+        update_layout_text();
     }
 
     void on_mousebuttonup(const SDL_Event &event)
@@ -483,13 +562,67 @@ private:
         }
     }
 
+    void update_layout_text()
+    {
+        if (m_game)
+        {
+            const EngineConfig &engine = m_game->engine();
+            m_layout_str = layout_name(engine.layout);
+
+            if (engine.layout == Layout::Tiled)
+            {
+                m_layout_str += " " + std::to_string(engine.tile_size);
+            }
+
+            m_layout_str += ", " + std::to_string(m_game->threads()) + " threads";
+        }
+        else
+        {
+            m_layout_str = m_autotune ? "auto" : layout_name(m_layout);
+        }
+    }
+
+    void update_stats_text(const Stats &stats)
+    {
+        char buf[64];
+        m_generation_str = std::to_string(stats.generation);
+        snprintf(buf, sizeof(buf), "%llu (%.1f%%)", (unsigned long long)stats.population, stats.density() * 100);
+        m_population_str = buf;
+
+        if (stats.empty())
+        {
+            m_bbox_str = "none";
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%dx%d, %.1f%% full", stats.max_x - stats.min_x + 1,
+                     stats.max_y - stats.min_y + 1, stats.box_density() * 100);
+            m_bbox_str = buf;
+        }
+    }
+
     void poll_event()
     {
-        SDL_Event event;
+        uint32_t input = EventGenerator::poll();
 
-        while (SDL_PollEvent(&event))
+        // Latency is measured from the oldest input that is not on screen yet
+        if (input && !m_input_time)
         {
-            EventGenerator::handle_event(event);
+            m_input_time = input;
+        }
+    }
+
+    // Called once the frame is presented, i.e. once the input shows up
+    void update_latency()
+    {
+        if (m_input_time)
+        {
+            uint32_t latency = SDL_GetTicks() - m_input_time;
+            m_input_time = 0;
+
+            // A moving average, in tenths of a millisecond
+            m_avg_latency += (int(latency) * 10 - m_avg_latency) / 8;
+            m_latency_str = std::to_string(latency) + " ms, avg " + std::to_string(m_avg_latency / 10) + " ms";
         }
     }
 
@@ -503,25 +636,44 @@ private:
             m_alive.clear();
             m_dead.clear();
 
-            void *pixels;
-            int pitch;
-            SDL_LockTexture(m_texture, nullptr, &pixels, &pitch);
-            uint8_t *ptr = (uint8_t *)pixels;
-
-            for (int y = 0; y < m_height; y++)
+            // The workers already drew the pixels, only the upload is left
+            if (const uint8_t *pixels = m_game->pixels())
             {
-                for (int x = 0; x < m_width; x++)
-                {
-                    ptr[y * pitch + x] = m_game->at(x, y).current ? m_alive_color : m_dead_color;
-                }
+                SDL_UpdateTexture(m_texture, nullptr, pixels, m_width);
             }
 
-            SDL_UnlockTexture(m_texture);
-
             SDL_Rect rect{X_OFFSET, Y_OFFSET, (m_size + X_PAD) * m_width, (m_size + Y_PAD) * m_height};
             SDL_RenderCopyEx(m_renderer, m_texture, nullptr, &m_camera, 0, nullptr, SDL_FLIP_NONE);
         }
 
+        if (m_game)
+        {
+            update_stats_text(m_game->stats());
+        }
+
+        if (m_capture)
+        {
+            m_capture_str = std::to_string(m_capture->written()) + " frames, " +
+                            std::to_string(m_capture->dropped()) + " dropped";
+        }
+        else
+        {
+            m_capture_str = "off";
+        }
+
+        m_stream_str = m_stream ? m_stream->name() : "off";
+        m_session_str = m_session ? m_session->path() : "off";
+
+        if (m_history)
+        {
+            m_history_str = std::to_string(m_history->first()) + "-" + std::to_string(m_history->last()) + ", " +
+                            std::to_string(m_history->memory_used() >> 10) + " kB";
+        }
+        else
+        {
+            m_history_str = "off";
+        }
+
         for (const auto &l : m_labels)
         {
             l->render(m_renderer);
@@ -536,6 +688,7 @@ private:
         SDL_RenderDrawRect(m_renderer, &m_camera);
 
         SDL_RenderPresent(m_renderer);
+        update_latency();
     }
 
 private:
@@ -549,20 +702,47 @@ private:
     int m_speed = 121;
     int m_width = 210;
     int m_height = 120;
+    Boundary m_boundary = Boundary::Torus;
+    Layout m_layout = Layout::RowMajor;
+    size_t m_rule = 0;
+    bool m_heat = false;
+    bool m_autotune = true;
+    Tuner m_tuner;
     uint8_t m_alive_color = 0x00;
     uint8_t m_dead_color = 0xff;
     std::string m_size_str;
     std::string m_speed_str;
     std::string m_width_str;
     std::string m_height_str;
+    std::string m_boundary_str;
+    std::string m_layout_str;
+    std::string m_rule_str;
+    std::string m_generation_str;
+    std::string m_population_str;
+    std::string m_bbox_str;
+    std::string m_capture_str;
+    std::string m_stream_str;
+    std::string m_history_str;
+    std::string m_latency_str{"-"};
+    std::string m_heat_str{"off"};
+    std::string m_session_str{"off"};
 
     std::vector<SDL_Rect> m_alive;
     std::vector<SDL_Rect> m_dead;
 
     Point m_mouse;
+    uint32_t m_input_time{0};
+    int m_avg_latency{0};
     std::vector<std::unique_ptr<Text>> m_labels;
 
     std::unique_ptr<Game> m_game;
+    std::unique_ptr<FrameCapture> m_capture;
+    std::unique_ptr<DeltaStream> m_stream;
+    std::unique_ptr<History> m_history;
+    std::unique_ptr<SessionRecorder> m_session;
+    // Ticks of the current board, commands are replayed on the same tick
+    uint64_t m_ticks{0};
+    std::random_device m_random;
 };
 
 int main(int argc, char **argv)
@@ -0,0 +1,309 @@
+#include "pattern.hh"
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    int parse_size(const std::string &value, const std::string &line)
+    {
+        int size = 0;
+
+        try
+        {
+            size = std::stoi(value);
+        }
+        catch (const std::logic_error &)
+        {
+            throw Error("Invalid RLE header: " + line);
+        }
+
+        if (size <= 0 || size > Pattern::MAX_SIZE)
+        {
+            throw Error("Invalid pattern size in RLE header: " + line);
+        }
+
+        return size;
+    }
+
+    void parse_header(const std::string &line, Pattern &pattern)
+    {
+        std::istringstream in(line);
+        std::string item;
+
+        while (std::getline(in, item, ','))
+        {
+            auto eq = item.find('=');
+
+            if (eq == std::string::npos)
+            {
+                throw Error("Invalid RLE header: " + line);
+            }
+
+            std::string key;
+            std::string value;
+
+            for (unsigned char c : item.substr(0, eq))
+            {
+                if (!isspace(c))
+                {
+                    key += c;
+                }
+            }
+
+            for (unsigned char c : item.substr(eq + 1))
+            {
+                if (!isspace(c))
+                {
+                    value += c;
+                }
+            }
+
+            if (key == "x")
+            {
+                pattern.width = parse_size(value, line);
+            }
+            else if (key == "y")
+            {
+                pattern.height = parse_size(value, line);
+            }
+            else if (key == "rule")
+            {
+                // Larger than Life rules contain commas, the rule is always last
+                std::string rest;
+
+                if (std::getline(in, rest))
+                {
+                    for (unsigned char c : "," + rest)
+                    {
+                        if (!isspace(c))
+                        {
+                            value += c;
+                        }
+                    }
+                }
+
+                pattern.rule = value;
+            }
+        }
+    }
+
+    // Calls cells(x, y, n, state) for every run of cells that are not dead in
+    // the body and returns the width and height the body covers. Throws Error
+    // if it is malformed or larger than Pattern::MAX_SIZE.
+    template <class Cells>
+    std::pair<int, int> walk_body(const std::string &body, Cells &&cells)
+    {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        int count = 0;
+        // Of the multi-state prefix, 'p' is 1
+        int prefix = 0;
+
+        for (unsigned char c : body)
+        {
+            if (prefix && !isupper(c))
+            {
+                throw Error("Invalid state in RLE");
+            }
+
+            if (isdigit(c))
+            {
+                count = count * 10 + (c - '0');
+
+                if (count > Pattern::MAX_SIZE)
+                {
+                    throw Error("Run is too long in RLE");
+                }
+
+                continue;
+            }
+            else if (isspace(c))
+            {
+                continue;
+            }
+
+            int n = count ? count : 1;
+            count = 0;
+
+            if (c == '!')
+            {
+                break;
+            }
+            else if (c == '$')
+            {
+                y += n;
+                x = 0;
+            }
+            else if (c == 'b' || c == '.')
+            {
+                x += n;
+            }
+            else if (c >= 'p' && c <= 'y' && !prefix)
+            {
+                // The count comes before the prefix
+                prefix = c - 'p' + 1;
+                count = n;
+                continue;
+            }
+            else if (isalpha(c))
+            {
+                int state = isupper(c) ? prefix * 24 + c - 'A' + 1 : 1;
+                prefix = 0;
+
+                if ((isupper(c) && c > 'X') || state > Rule::MAX_STATES - 1)
+                {
+                    throw Error(std::string("Invalid state in RLE: ") + char(c));
+                }
+
+                if (x + n > Pattern::MAX_SIZE || y >= Pattern::MAX_SIZE)
+                {
+                    throw Error("Pattern is too large");
+                }
+
+                cells(x, y, n, state);
+                x += n;
+                height = std::max(height, y + 1);
+            }
+            else
+            {
+                throw Error(std::string("Invalid character in RLE: ") + char(c));
+            }
+
+            if (x > Pattern::MAX_SIZE || y > Pattern::MAX_SIZE)
+            {
+                throw Error("Pattern is too large");
+            }
+
+            width = std::max(width, x);
+        }
+
+        return {width, height};
+    }
+
+    void append_run(std::string &body, size_t &line_start, int count, char tag)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        std::string run = (count > 1 ? std::to_string(count) : "") + tag;
+
+        if (body.size() - line_start + run.size() > 70)
+        {
+            body += '\n';
+            line_start = body.size();
+        }
+
+        body += run;
+    }
+}
+
+// static
+Pattern Pattern::parse_rle(const std::string &text)
+{
+    Pattern pattern;
+    std::istringstream in(text);
+    std::string line;
+    std::string body;
+
+    while (std::getline(in, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+
+        if (first == std::string::npos || line[first] == '#')
+        {
+            continue;
+        }
+        else if (line[first] == 'x' && body.empty())
+        {
+            parse_header(line, pattern);
+        }
+        else
+        {
+            body += line;
+        }
+    }
+
+    // The first pass finds the size, the header is optional
+    auto [width, height] = walk_body(body, [](int, int, int, int) {});
+    pattern.width = std::max(pattern.width, width);
+    pattern.height = std::max(pattern.height, height);
+
+    if (size_t(pattern.width) * pattern.height > MAX_CELLS)
+    {
+        throw Error("Pattern is too large");
+    }
+
+    pattern.cells.resize(size_t(pattern.width) * pattern.height);
+
+    walk_body(body, [&](int x, int y, int n, int state)
+              {
+                  for (int i = 0; i < n; i++)
+                  {
+                      pattern.cells[size_t(y) * pattern.width + x + i] = state;
+                  }
+              });
+
+    return pattern;
+}
+
+// static
+Pattern Pattern::load(const std::string &filename)
+{
+    std::ifstream file(filename);
+
+    if (!file)
+    {
+        throw Error("Could not open " + filename);
+    }
+
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return parse_rle(ss.str());
+}
+
+std::string to_rle(const Snapshot &snapshot, const Rule &rule)
+{
+    std::string header = "x = " + std::to_string(snapshot.width) +
+                         ", y = " + std::to_string(snapshot.height) +
+                         ", rule = " + rule.to_string() + "\n";
+    std::string body;
+    size_t line_start = 0;
+    int row_ends = 0;
+
+    for (int y = 0; y < snapshot.height; y++)
+    {
+        int dead = 0;
+        int live = 0;
+
+        for (int x = 0; x < snapshot.width; x++)
+        {
+            if (snapshot.alive(x, y))
+            {
+                // Row ends are only written when needed, which folds empty rows
+                // into one run and drops the trailing ones
+                append_run(body, line_start, row_ends, '$');
+                row_ends = 0;
+                append_run(body, line_start, dead, 'b');
+                dead = 0;
+                live++;
+            }
+            else
+            {
+                append_run(body, line_start, live, 'o');
+                live = 0;
+                dead++;
+            }
+        }
+
+        append_run(body, line_start, live, 'o');
+        row_ends++;
+    }
+
+    return header + body + "!\n";
+}
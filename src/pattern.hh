@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.hh"
+#include "rule.hh"
+
+#include <vector>
+
+// An immutable copy of the board at a given generation. Cell x of row y is bit
+// x % 64 of word y * words_per_row + x / 64.
+struct Snapshot
+{
+    uint64_t generation = 0;
+    int width = 0;
+    int height = 0;
+    int words_per_row = 0;
+    std::vector<uint64_t> bits;
+
+    bool alive(int x, int y) const
+    {
+        return (bits[y * words_per_row + x / 64] >> (x % 64)) & 1;
+    }
+};
+
+// A rectangular pattern of cells, usually read from an RLE file
+struct Pattern
+{
+    // Larger patterns are rejected by the parser
+    static constexpr int MAX_SIZE = 1 << 16;
+    static constexpr size_t MAX_CELLS = size_t(1) << 28;
+
+    int width = 0;
+    int height = 0;
+    std::string rule;
+    // 0 is dead and 1 alive, from 2 on the dying states of Generations rules
+    std::vector<uint8_t> cells;
+
+    int state(int x, int y) const
+    {
+        return cells[size_t(y) * width + x];
+    }
+
+    bool alive(int x, int y) const
+    {
+        return state(x, y) == 1;
+    }
+
+    // Parses the RLE format, with or without the header line. Multi-state
+    // patterns have the states A to X and pA to yO. 'o' and the lower case
+    // letters that are not a prefix are alive. Throws Error if the pattern is malformed.
+    static Pattern parse_rle(const std::string &text);
+
+    static Pattern load(const std::string &filename);
+};
+
+// Encodes the snapshot as RLE, lines are wrapped at 70 characters
+std::string to_rle(const Snapshot &snapshot, const Rule &rule);
@@ -0,0 +1,239 @@
+#include "rule.hh"
+
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    uint16_t parse_digits(const std::string &str, const std::string &rule)
+    {
+        uint16_t mask = 0;
+
+        for (char c : str)
+        {
+            if (c < '0' || c > '8')
+            {
+                throw Error("Invalid rule: " + rule);
+            }
+
+            mask |= 1 << (c - '0');
+        }
+
+        return mask;
+    }
+
+    std::string digits(uint16_t mask)
+    {
+        std::string str;
+
+        for (int i = 0; i <= 8; i++)
+        {
+            if (mask & (1 << i))
+            {
+                str += char('0' + i);
+            }
+        }
+
+        return str;
+    }
+
+    int parse_int(const std::string &str, const std::string &rule)
+    {
+        if (str.empty() || str.size() > 6 || str.find_first_not_of("0123456789") != std::string::npos)
+        {
+            throw Error("Invalid rule: " + rule);
+        }
+
+        return std::stoi(str);
+    }
+
+    // The number of states of a Generations rule, with or without the C prefix
+    int parse_states(const std::string &str, const std::string &rule)
+    {
+        int states = parse_int(str.size() > 1 && (str[0] == 'C' || str[0] == 'G') ? str.substr(1) : str, rule);
+
+        if (states < 2 || states > Rule::MAX_STATES)
+        {
+            throw Error("Invalid number of states: " + rule);
+        }
+
+        return states;
+    }
+
+    void parse_interval(const std::string &str, int &min, int &max, const std::string &rule)
+    {
+        auto dots = str.find("..");
+
+        if (dots == std::string::npos)
+        {
+            min = max = parse_int(str, rule);
+        }
+        else
+        {
+            min = parse_int(str.substr(0, dots), rule);
+            max = parse_int(str.substr(dots + 2), rule);
+
+            // The kernels test the interval as an unsigned count - min <= max - min
+            if (min > max)
+            {
+                throw Error("Invalid rule: " + rule);
+            }
+        }
+    }
+
+    // Comma separated fields in any order, e.g. R5,C0,M1,S34..58,B34..45,NM
+    Rule parse_larger_than_life(const std::string &upper, const std::string &str)
+    {
+        Rule rule;
+        bool has_birth = false;
+        bool has_survival = false;
+        size_t pos = 0;
+
+        while (pos <= upper.size())
+        {
+            size_t comma = std::min(upper.find(',', pos), upper.size());
+            std::string field = upper.substr(pos, comma - pos);
+            pos = comma + 1;
+
+            if (field.size() < 2)
+            {
+                throw Error("Invalid rule: " + str);
+            }
+
+            std::string value = field.substr(1);
+
+            switch (field[0])
+            {
+            case 'R':
+                rule.range = parse_int(value, str);
+                break;
+            case 'C':
+                // C0 and C2 both mean two states
+                rule.states = value == "0" ? 2 : parse_states(value, str);
+                break;
+            case 'M':
+                rule.center = parse_int(value, str) != 0;
+                break;
+            case 'S':
+                parse_interval(value, rule.survival_min, rule.survival_max, str);
+                has_survival = true;
+                break;
+            case 'B':
+                parse_interval(value, rule.birth_min, rule.birth_max, str);
+                has_birth = true;
+                break;
+            case 'N':
+                if (value != "M")
+                {
+                    throw Error("Only the Moore neighbourhood is supported: " + str);
+                }
+                break;
+            default:
+                throw Error("Invalid rule: " + str);
+            }
+        }
+
+        if (rule.range < 1 || rule.range > Rule::MAX_RANGE || !has_birth || !has_survival)
+        {
+            throw Error("Invalid rule: " + str);
+        }
+
+        // A range of one is a Life-like rule, which the default kernel handles
+        rule.birth = 0;
+        rule.survival = 0;
+
+        if (rule.range == 1)
+        {
+            for (int n = 0; n <= 8; n++)
+            {
+                // A dead cell doesn't add to its own count
+                int count = n + rule.center;
+                rule.birth |= (n >= rule.birth_min && n <= rule.birth_max) << n;
+                rule.survival |= (count >= rule.survival_min && count <= rule.survival_max) << n;
+            }
+
+            rule.center = false;
+            rule.birth_min = rule.birth_max = rule.survival_min = rule.survival_max = 0;
+        }
+
+        return rule;
+    }
+}
+
+// static
+Rule Rule::parse(const std::string &str)
+{
+    std::string upper;
+
+    for (unsigned char c : str)
+    {
+        upper += char(toupper(c));
+    }
+
+    if (!upper.empty() && upper[0] == 'R')
+    {
+        return parse_larger_than_life(upper, str);
+    }
+
+    auto slash = upper.find('/');
+
+    if (slash == std::string::npos)
+    {
+        throw Error("Invalid rule: " + str);
+    }
+
+    std::string lhs = upper.substr(0, slash);
+    std::string rhs = upper.substr(slash + 1);
+    Rule rule;
+
+    // Generations rules have the number of states as a third field
+    auto states_slash = rhs.find('/');
+
+    if (states_slash != std::string::npos)
+    {
+        rule.states = parse_states(rhs.substr(states_slash + 1), str);
+        rhs = rhs.substr(0, states_slash);
+    }
+
+    if (!lhs.empty() && lhs[0] == 'B' && !rhs.empty() && rhs[0] == 'S')
+    {
+        rule.birth = parse_digits(lhs.substr(1), str);
+        rule.survival = parse_digits(rhs.substr(1), str);
+    }
+    else if (!lhs.empty() && lhs[0] == 'S' && !rhs.empty() && rhs[0] == 'B')
+    {
+        rule.survival = parse_digits(lhs.substr(1), str);
+        rule.birth = parse_digits(rhs.substr(1), str);
+    }
+    else
+    {
+        // The traditional survival/birth notation
+        rule.survival = parse_digits(lhs, str);
+        rule.birth = parse_digits(rhs, str);
+    }
+
+    return rule;
+}
+
+std::string Rule::to_string() const
+{
+    if (larger_than_life())
+    {
+        auto interval = [](int min, int max)
+        {
+            return min == max ? std::to_string(min) : std::to_string(min) + ".." + std::to_string(max);
+        };
+
+        return "R" + std::to_string(range) + ",C" + std::to_string(states == 2 ? 0 : states) + ",M" + std::to_string(center) + ",S" +
+               interval(survival_min, survival_max) + ",B" + interval(birth_min, birth_max) + ",NM";
+    }
+
+    std::string str = "B" + digits(birth) + "/S" + digits(survival);
+
+    if (generations())
+    {
+        str += "/C" + std::to_string(states);
+    }
+
+    return str;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hh"
+
+// A Life-like rule. Bit n of birth is set if a dead cell with n live neighbours
+// comes alive, bit n of survival if a live cell with n neighbours stays alive.
+//
+// Larger than Life rules have a range of more than one. The neighbourhood is
+// then the square of 2 * range + 1 cells around the cell, and birth and
+// survival are intervals of the number of live cells in it.
+//
+// Generations rules have more than two states. A live cell that doesn't survive
+// goes through the dying states 2 to states - 1 before it is dead again. Dying
+// cells are not counted as neighbours and can't be born.
+struct Rule
+{
+    static constexpr int MAX_RANGE = 100;
+    static constexpr int MAX_STATES = 256;
+
+    uint16_t birth = 1 << 3;
+    uint16_t survival = 1 << 2 | 1 << 3;
+
+    int range = 1;
+    // Whether a cell counts itself as a neighbour
+    bool center = false;
+    int birth_min = 0;
+    int birth_max = 0;
+    int survival_min = 0;
+    int survival_max = 0;
+
+    int states = 2;
+
+    // Accepts both "B3/S23" and "23/3" notation, Generations rules as "B2/S/C3"
+    // or "/2/3", and the "R5,C0,M1,S34..58,B34..45,NM" notation of Larger than
+    // Life. Throws Error if the rule is invalid.
+    static Rule parse(const std::string &str);
+
+    bool larger_than_life() const
+    {
+        return range > 1;
+    }
+
+    bool generations() const
+    {
+        return states > 2;
+    }
+
+    std::string to_string() const;
+
+    // The rule as a lookup table indexed by neighbours + 9 * alive
+    uint32_t table() const
+    {
+        return birth | uint32_t(survival) << 9;
+    }
+
+    bool operator==(const Rule &) const = default;
+};
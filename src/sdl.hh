@@ -0,0 +1,8 @@
+#pragma once
+
+// Only the GUI depends on SDL, the simulation in fast_life_core must not
+// include this
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_ttf.h>
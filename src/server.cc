@@ -0,0 +1,477 @@
+#include "server.hh"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+Server::Server(std::string path, int width, int height, Boundary boundary, EngineConfig engine, std::string pattern_dir)
+{
+    throw Error("The server is not supported on this platform");
+}
+
+Server::~Server()
+{
+}
+
+void Server::run()
+{
+}
+
+#else
+
+namespace
+{
+    int read_int(std::istringstream &in, const char *what)
+    {
+        int value;
+
+        if (!(in >> value))
+        {
+            throw Error(std::string("Expected ") + what);
+        }
+
+        return value;
+    }
+
+    std::string rest_of_line(std::istringstream &in)
+    {
+        std::string rest;
+        std::getline(in >> std::ws, rest);
+
+        if (rest.empty())
+        {
+            throw Error("Missing argument");
+        }
+
+        return rest;
+    }
+}
+
+Server::Server(std::string path, int width, int height, Boundary boundary, EngineConfig engine, std::string pattern_dir)
+    : m_path(path),
+      m_boundary(boundary)
+{
+    if (!pattern_dir.empty())
+    {
+        std::error_code ec;
+        m_pattern_dir = std::filesystem::canonical(pattern_dir, ec);
+
+        if (ec || !std::filesystem::is_directory(m_pattern_dir))
+        {
+            throw Error("Not a directory: " + pattern_dir);
+        }
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+
+    if (m_path.size() >= sizeof(addr.sun_path))
+    {
+        throw Error("Socket path is too long: " + m_path);
+    }
+
+    strcpy(addr.sun_path, m_path.c_str());
+    unlink(m_path.c_str());
+
+    m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (m_listen_fd == -1 || bind(m_listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(m_listen_fd, 16) != 0)
+    {
+        std::string err = strerror(errno);
+
+        if (m_listen_fd != -1)
+        {
+            close(m_listen_fd);
+        }
+
+        throw Error("Could not listen on " + m_path + ": " + err);
+    }
+
+    if (pipe(m_wake_fds) != 0)
+    {
+        close(m_listen_fd);
+        throw Error(std::string("Could not create pipe: ") + strerror(errno));
+    }
+
+    // Start from an empty board, the first tick publishes it
+    m_game = std::make_unique<Game>(height, width, boundary, engine);
+    m_game->set_snapshots(true);
+    m_game->clear();
+    m_game->tick();
+
+    m_sim_thread = std::thread(&Server::sim_thr, this);
+}
+
+Server::~Server()
+{
+    {
+        std::lock_guard guard(m_lock);
+        m_sim_running = false;
+    }
+
+    m_cond.notify_one();
+    m_sim_thread.join();
+    m_game.reset();
+
+    for (auto &c : m_clients)
+    {
+        close(c.fd);
+    }
+
+    close(m_wake_fds[0]);
+    close(m_wake_fds[1]);
+    close(m_listen_fd);
+    unlink(m_path.c_str());
+}
+
+void Server::run()
+{
+    while (m_running)
+    {
+        std::vector<pollfd> fds;
+        fds.push_back({m_listen_fd, POLLIN, 0});
+        fds.push_back({m_wake_fds[0], POLLIN, 0});
+
+        for (const auto &c : m_clients)
+        {
+            // Clients waiting for a STEP to finish are not read from, this keeps
+            // the replies in order
+            fds.push_back({c.fd, short(c.waiting_for ? 0 : POLLIN), 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw Error(std::string("poll failed: ") + strerror(errno));
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char buf[64];
+            [[maybe_unused]] auto rc = read(m_wake_fds[0], buf, sizeof(buf));
+        }
+
+        for (size_t i = 2; i < fds.size(); i++)
+        {
+            Client &client = m_clients[i - 2];
+
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                char buf[4096];
+                auto n = recv(client.fd, buf, sizeof(buf), 0);
+
+                if (n <= 0)
+                {
+                    client.closing = true;
+                    continue;
+                }
+
+                client.input.append(buf, n);
+            }
+        }
+
+        for (auto &client : m_clients)
+        {
+            if (client.closing)
+            {
+                continue;
+            }
+
+            if (client.waiting_for && current_generation() >= client.waiting_for)
+            {
+                client.waiting_for = 0;
+                reply(client, "OK " + std::to_string(current_generation()));
+            }
+
+            size_t eol;
+
+            while (!client.waiting_for && m_running && (eol = client.input.find('\n')) != std::string::npos)
+            {
+                std::string line = client.input.substr(0, eol);
+                client.input.erase(0, eol + 1);
+
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+
+                if (line == "QUIT")
+                {
+                    client.closing = true;
+                    break;
+                }
+
+                execute(client, line);
+            }
+        }
+
+        std::erase_if(m_clients, [](const auto &c)
+                      {
+                          if (c.closing)
+                          {
+                              close(c.fd);
+                          }
+
+                          return c.closing;
+                      });
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(m_listen_fd, nullptr, nullptr);
+
+            if (fd != -1)
+            {
+                m_clients.push_back(Client{fd, {}, 0, false});
+            }
+        }
+    }
+}
+
+uint64_t Server::current_generation() const
+{
+    return m_game->generation();
+}
+
+// Clients can only read the files under the pattern directory, symbolic links
+// included
+std::string Server::pattern_path(const std::string &name) const
+{
+    if (m_pattern_dir.empty())
+    {
+        throw Error("LOADFILE is disabled, the server has no pattern directory");
+    }
+
+    std::error_code ec;
+    auto path = std::filesystem::canonical(m_pattern_dir / name, ec);
+
+    if (ec)
+    {
+        throw Error("Could not open " + name);
+    }
+
+    auto relative = path.lexically_relative(m_pattern_dir);
+
+    if (relative.empty() || *relative.begin() == "..")
+    {
+        throw Error("Not in the pattern directory: " + name);
+    }
+
+    return path.string();
+}
+
+void Server::reply(Client &client, const std::string &text)
+{
+    std::string msg = text + "\n";
+    size_t pos = 0;
+
+    while (pos < msg.size())
+    {
+        auto n = send(client.fd, msg.data() + pos, msg.size() - pos, MSG_NOSIGNAL);
+
+        if (n <= 0)
+        {
+            // The client is gone, its socket will report it on the next poll
+            break;
+        }
+
+        pos += n;
+    }
+}
+
+void Server::execute(Client &client, const std::string &line)
+{
+    std::istringstream in(line);
+    std::string cmd;
+    in >> cmd;
+
+    try
+    {
+        if (cmd == "LOAD" || cmd == "LOADFILE")
+        {
+            int x = read_int(in, "x");
+            int y = read_int(in, "y");
+
+            if (x < 0 || x >= m_game->width() || y < 0 || y >= m_game->height())
+            {
+                throw Error("Position is outside of the board");
+            }
+
+            std::string arg = rest_of_line(in);
+            m_game->load(cmd == "LOAD" ? Pattern::parse_rle(arg) : Pattern::load(pattern_path(arg)), x, y);
+            reply(client, "OK");
+        }
+        else if (cmd == "CLEAR")
+        {
+            m_game->clear();
+            reply(client, "OK");
+        }
+        else if (cmd == "STEP")
+        {
+            int n = read_int(in, "number of generations");
+
+            if (n <= 0)
+            {
+                throw Error("Number of generations must be positive");
+            }
+
+            std::lock_guard guard(m_lock);
+            m_target = std::max(m_target, current_generation()) + n;
+            client.waiting_for = m_target;
+            m_cond.notify_one();
+        }
+        else if (cmd == "RULE")
+        {
+            // Only a rule the board accepted is reported back
+            Rule rule = Rule::parse(rest_of_line(in));
+            m_game->set_rule(rule);
+            m_rule = rule;
+            reply(client, "OK");
+        }
+        else if (cmd == "BOUNDARY")
+        {
+            Boundary boundary = parse_boundary(rest_of_line(in));
+            m_game->set_boundary(boundary);
+            m_boundary = boundary;
+            reply(client, "OK");
+        }
+        else if (cmd == "SPEED")
+        {
+            int speed = read_int(in, "speed");
+
+            if (speed < 0)
+            {
+                throw Error("Speed must not be negative");
+            }
+
+            std::lock_guard guard(m_lock);
+            m_speed = speed;
+            m_cond.notify_one();
+            reply(client, "OK");
+        }
+        else if (cmd == "QUERY")
+        {
+            int x = read_int(in, "x");
+            int y = read_int(in, "y");
+            int w = read_int(in, "width");
+            int h = read_int(in, "height");
+            auto snapshot = m_game->snapshot();
+
+            if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > snapshot->width || y + h > snapshot->height)
+            {
+                throw Error("Region is outside of the board");
+            }
+
+            std::string out = "OK " + std::to_string(snapshot->generation) + " " + std::to_string(h);
+
+            for (int row = y; row < y + h; row++)
+            {
+                out += '\n';
+
+                for (int col = x; col < x + w; col++)
+                {
+                    out += snapshot->alive(col, row) ? 'o' : '.';
+                }
+            }
+
+            reply(client, out);
+        }
+        else if (cmd == "SNAPSHOT")
+        {
+            auto snapshot = m_game->snapshot();
+            std::string rle = to_rle(*snapshot, m_rule);
+            rle.pop_back();
+            auto lines = std::count(rle.begin(), rle.end(), '\n') + 1;
+            reply(client, "OK " + std::to_string(snapshot->generation) + " " + std::to_string(lines) + "\n" + rle);
+        }
+        else if (cmd == "STATUS")
+        {
+            Stats stats = m_game->stats();
+            std::string bbox = "none";
+
+            if (!stats.empty())
+            {
+                bbox = std::to_string(stats.min_x) + "," + std::to_string(stats.min_y) + "," +
+                       std::to_string(stats.max_x) + "," + std::to_string(stats.max_y);
+            }
+
+            std::lock_guard guard(m_lock);
+            reply(client, "OK generation=" + std::to_string(stats.generation) +
+                              " population=" + std::to_string(stats.population) +
+                              " bbox=" + bbox +
+                              " width=" + std::to_string(m_game->width()) +
+                              " height=" + std::to_string(m_game->height()) +
+                              " rule=" + m_rule.to_string() +
+                              " boundary=" + boundary_name(m_boundary) +
+                              " speed=" + std::to_string(m_speed));
+        }
+        else if (cmd == "SHUTDOWN")
+        {
+            m_running = false;
+            reply(client, "OK");
+        }
+        else
+        {
+            throw Error("Unknown command: " + cmd);
+        }
+    }
+    catch (const std::exception &err)
+    {
+        reply(client, std::string("ERR ") + err.what());
+    }
+}
+
+void Server::sim_thr()
+{
+    using namespace std::chrono;
+    auto last_tick = steady_clock::now();
+    std::unique_lock guard(m_lock);
+
+    while (m_sim_running)
+    {
+        bool stepping = current_generation() < m_target;
+
+        if (!stepping)
+        {
+            if (m_speed == 0)
+            {
+                m_cond.wait(guard);
+                continue;
+            }
+
+            auto next_tick = last_tick + nanoseconds(1000000000 / m_speed);
+
+            if (steady_clock::now() < next_tick)
+            {
+                m_cond.wait_until(guard, next_tick);
+                continue;
+            }
+        }
+
+        guard.unlock();
+        last_tick = steady_clock::now();
+        m_game->tick();
+        guard.lock();
+
+        if (stepping && current_generation() >= m_target)
+        {
+            // Wakes up the socket thread so that it replies to the STEP
+            [[maybe_unused]] auto rc = write(m_wake_fds[1], "", 1);
+        }
+    }
+}
+
+#endif
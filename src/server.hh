@@ -0,0 +1,76 @@
+#pragma once
+
+#include "game.hh"
+
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+// Runs a game without a window and takes commands over a Unix domain socket.
+// The protocol is line based, every command gets one reply line that starts
+// with either OK or ERR. Replies with a payload announce the number of lines
+// that follow.
+//
+//   LOAD <x> <y> <rle>   Load a pattern, the RLE body must be on one line
+//   LOADFILE <x> <y> <path> Load a pattern file from the pattern directory
+//   CLEAR
+//   STEP <n>             Replies once n more generations have been computed
+//   RULE <rule>          E.g. B3/S23, B2/S/C3 or R5,C0,M1,S34..58,B34..45,NM
+//   BOUNDARY <name>      torus, dead, klein or mirror
+//   SPEED <n>            Generations per second when not stepping, 0 pauses
+//   QUERY <x> <y> <w> <h>
+//   SNAPSHOT             The whole board as RLE
+//   STATUS               Generation, population, bounding box and settings
+//   QUIT                 Closes the connection
+//   SHUTDOWN             Stops the server
+//
+// Edits take effect on the next generation boundary. Queries are answered from
+// the latest published snapshot while the simulation keeps running.
+class Server
+{
+public:
+    // LOADFILE only reads files under pattern_dir, it is disabled if that is
+    // empty. Throws Error if the directory doesn't exist.
+    Server(std::string path, int width, int height, Boundary boundary = Boundary::Torus, EngineConfig engine = {},
+           std::string pattern_dir = "");
+    ~Server();
+
+    // Serves clients until a SHUTDOWN command is received
+    void run();
+
+private:
+    struct Client
+    {
+        int fd;
+        std::string input;
+        uint64_t waiting_for = 0;
+        // Hung up or sent QUIT, its commands are no longer run
+        bool closing = false;
+    };
+
+    void execute(Client &client, const std::string &line);
+    void reply(Client &client, const std::string &text);
+    void sim_thr();
+    uint64_t current_generation() const;
+    std::string pattern_path(const std::string &name) const;
+
+    std::string m_path;
+    std::filesystem::path m_pattern_dir;
+    int m_listen_fd{-1};
+    int m_wake_fds[2]{-1, -1};
+    bool m_running{true};
+    std::vector<Client> m_clients;
+
+    std::unique_ptr<Game> m_game;
+    Rule m_rule;
+    Boundary m_boundary;
+
+    // Protects the fields below, shared with the simulation thread
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    uint64_t m_target{0};
+    int m_speed{0};
+    bool m_sim_running{true};
+    std::thread m_sim_thread;
+};
@@ -0,0 +1,330 @@
+#include "session.hh"
+#include "history.hh"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    const std::string HEADER = "fast_life_session 1";
+
+    // The generations between two commands
+    struct Segment
+    {
+        int board;
+        uint64_t generation;
+        std::string command;
+        uint64_t generations = 0;
+        double ms = 0;
+        double max_ms = 0;
+    };
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+
+        auto nth = values.begin() + std::min(values.size() - 1, size_t(p * values.size()));
+        std::nth_element(values.begin(), nth, values.end());
+        return *nth;
+    }
+}
+
+std::string SessionStart::to_string() const
+{
+    std::ostringstream out;
+    out << "width=" << width << " height=" << height << " seed=" << seed << " boundary=" << boundary_name(boundary)
+        << " layout=" << layout_name(engine.layout) << " tile=" << engine.tile_size << " threads=" << engine.threads
+        << " rule=" << rule << " history=" << history << " pixels=" << pixels;
+    return out.str();
+}
+
+// static
+SessionStart SessionStart::parse(const std::string &args)
+{
+    std::map<std::string, std::string> values;
+    std::istringstream in(args);
+    std::string field;
+
+    while (in >> field)
+    {
+        auto eq = field.find('=');
+
+        if (eq == std::string::npos)
+        {
+            throw Error("Invalid setting: " + field);
+        }
+
+        values[field.substr(0, eq)] = field.substr(eq + 1);
+    }
+
+    auto get = [&](const std::string &key)
+    {
+        auto it = values.find(key);
+
+        if (it == values.end())
+        {
+            throw Error("Missing setting: " + key);
+        }
+
+        return it->second;
+    };
+
+    SessionStart start;
+
+    try
+    {
+        start.width = std::stoi(get("width"));
+        start.height = std::stoi(get("height"));
+        start.seed = std::stoull(get("seed"));
+        start.engine.tile_size = std::stoi(get("tile"));
+        start.engine.threads = std::stoi(get("threads"));
+        start.history = std::stoull(get("history"));
+        start.pixels = get("pixels") == "1";
+    }
+    catch (const std::logic_error &)
+    {
+        throw Error("Invalid settings: " + args);
+    }
+
+    start.boundary = parse_boundary(get("boundary"));
+    start.engine.layout = parse_layout(get("layout"));
+    start.rule = get("rule");
+
+    if (start.width <= 0 || start.height <= 0)
+    {
+        throw Error("Invalid board size: " + args);
+    }
+
+    return start;
+}
+
+SessionRecorder::SessionRecorder(const std::string &path)
+    : m_path(path),
+      m_out(path),
+      m_start(std::chrono::steady_clock::now())
+{
+    if (!m_out)
+    {
+        throw Error("Could not open " + path + " for writing");
+    }
+
+    m_out << HEADER << std::endl;
+}
+
+void SessionRecorder::record(uint64_t ticks, uint64_t generation, const std::string &command)
+{
+    using namespace std::chrono;
+    auto ms = duration_cast<milliseconds>(steady_clock::now() - m_start).count();
+    m_out << ms << " " << ticks << " " << generation << " " << command << std::endl;
+}
+
+void replay_session(std::ostream &out, const std::string &path, const std::string &timings_path)
+{
+    using namespace std::chrono;
+    std::ifstream in(path);
+    std::string line;
+
+    if (!in)
+    {
+        throw Error("Could not open " + path);
+    }
+
+    if (!std::getline(in, line) || line != HEADER)
+    {
+        throw Error(path + " is not a recorded session");
+    }
+
+    std::ofstream timings;
+
+    if (!timings_path.empty())
+    {
+        timings.open(timings_path);
+
+        if (!timings)
+        {
+            throw Error("Could not open " + timings_path + " for writing");
+        }
+
+        timings << "board,generation,ms\n";
+    }
+
+    std::unique_ptr<History> history;
+    std::unique_ptr<Game> game;
+    uint64_t ticks = 0;
+
+    std::vector<Segment> segments;
+    std::vector<double> times;
+    int boards = 0;
+    int commands = 0;
+    int skipped = 0;
+
+    // Ticks the board up to the tick the command was given on
+    auto advance = [&](uint64_t target)
+    {
+        while (game && ticks < target)
+        {
+            auto start = steady_clock::now();
+            game->tick();
+            double ms = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1e6;
+            ticks++;
+
+            Segment &segment = segments.back();
+            segment.generations++;
+            segment.ms += ms;
+            segment.max_ms = std::max(segment.max_ms, ms);
+            times.push_back(ms);
+
+            if (timings.is_open())
+            {
+                timings << boards << "," << game->generation() << "," << ms << "\n";
+            }
+        }
+    };
+
+    for (int line_number = 2; std::getline(in, line); line_number++)
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        uint64_t ms;
+        uint64_t command_ticks;
+        uint64_t generation;
+        std::string command;
+
+        if (!(fields >> ms >> command_ticks >> generation >> command))
+        {
+            throw Error("Invalid line " + std::to_string(line_number) + " in " + path);
+        }
+
+        std::string args;
+        std::getline(fields >> std::ws, args);
+        commands++;
+
+        if (command != "START")
+        {
+            if (!game)
+            {
+                throw Error("No board for the command on line " + std::to_string(line_number));
+            }
+
+            // Ticks only go forward on a board, a command stamped before the
+            // previous one would be applied on the wrong tick
+            if (command_ticks < ticks)
+            {
+                throw Error("The command on line " + std::to_string(line_number) + " is stamped before the previous one");
+            }
+
+            advance(command_ticks);
+
+            if (game->generation() != generation)
+            {
+                throw Error("The replay diverged from the session on line " + std::to_string(line_number));
+            }
+        }
+
+        if (command == "START")
+        {
+            SessionStart start = SessionStart::parse(args);
+            game.reset();
+            history.reset();
+
+            if (start.history)
+            {
+                history = std::make_unique<History>(start.width, start.height, start.history);
+            }
+
+            game = std::make_unique<Game>(start.height, start.width, start.boundary, start.engine, start.seed);
+            game->set_history(history.get());
+            game->set_pixels(start.pixels);
+            game->set_rule(Rule::parse(start.rule));
+            ticks = 0;
+            boards++;
+        }
+        else if (command == "STOP" || command == "END")
+        {
+            if (!args.empty() && game->stats().population != std::stoull(args))
+            {
+                throw Error("The replay diverged from the session on line " + std::to_string(line_number) +
+                            ", the population is " + std::to_string(game->stats().population));
+            }
+
+            game.reset();
+            history.reset();
+        }
+        else if (command == "RULE")
+        {
+            game->set_rule(Rule::parse(args));
+        }
+        else if (command == "BOUNDARY")
+        {
+            game->set_boundary(parse_boundary(args));
+        }
+        else if (command == "PALETTE")
+        {
+            int alive;
+            int dead;
+            std::istringstream(args) >> alive >> dead;
+            game->set_palette(alive, dead);
+        }
+        else if (command == "HEAT")
+        {
+            game->set_heat(args == "on");
+        }
+        else if (command == "REWIND")
+        {
+            auto snapshot = history ? history->reconstruct(std::stoull(args)) : nullptr;
+
+            if (!snapshot)
+            {
+                throw Error("Generation " + args + " is not in the history on line " + std::to_string(line_number));
+            }
+
+            game->restore(snapshot);
+        }
+        else if (command == "CAPTURE" || command == "STREAM")
+        {
+            skipped++;
+        }
+        else if (command != "SPEED")
+        {
+            throw Error("Unknown command on line " + std::to_string(line_number) + ": " + command);
+        }
+
+        segments.push_back({boards, generation, command + (args.empty() ? "" : " " + args)});
+    }
+
+    double total_ms = 0;
+
+    for (double ms : times)
+    {
+        total_ms += ms;
+    }
+
+    out << "session      " << path << std::endl;
+    out << "boards       " << boards << ", " << commands << " commands, " << skipped << " not replayed" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    out << "generations  " << times.size() << " in " << total_ms << " ms, "
+        << (times.empty() ? 0 : total_ms / times.size()) << " ms/gen" << std::endl;
+    out << "p50 p99 max  " << percentile(times, 0.5) << " " << percentile(times, 0.99) << " "
+        << (times.empty() ? 0 : *std::max_element(times.begin(), times.end())) << " ms" << std::endl;
+    out << std::endl;
+    out << std::setw(6) << "board" << std::setw(12) << "generation" << std::setw(8) << "gens" << std::setw(10)
+        << "ms/gen" << std::setw(10) << "max ms" << "  after" << std::endl;
+
+    for (const Segment &segment : segments)
+    {
+        out << std::setw(6) << segment.board << std::setw(12) << segment.generation << std::setw(8)
+            << segment.generations << std::setw(10) << (segment.generations ? segment.ms / segment.generations : 0)
+            << std::setw(10) << segment.max_ms << "  " << segment.command << std::endl;
+    }
+}
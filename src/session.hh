@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.hh"
+#include "game.hh"
+
+#include <chrono>
+#include <fstream>
+#include <ostream>
+
+// A recorded session is a text file with a header line and then one line per
+// command:
+//
+//   <ms since the recording started> <ticks> <generation> <COMMAND> [arguments]
+//
+// Ticks is the number of times the board was ticked since it started and the
+// generation is that of the board when the command was given, i.e. the command
+// took effect on the tick after it. The generation goes back on a rewind, the
+// ticks don't. The commands are:
+//
+//   START key=value ...   A new board, see SessionStart
+//   STOP <population>     The board was dropped
+//   RULE <rule>
+//   BOUNDARY <name>
+//   PALETTE <alive> <dead>
+//   HEAT on|off
+//   REWIND <generation>   Restored from the history
+//   SPEED <n>             Generations per second, replays run at full speed
+//   CAPTURE, STREAM       Recorded but not replayed
+//   END <population>      The last generation of the session
+//
+// Since the boards are seeded and the commands are applied on the same ticks, a
+// replay goes through exactly the same generations. The population at the end
+// of a board is checked to make sure of that.
+
+// The settings of a new board
+struct SessionStart
+{
+    int width = 0;
+    int height = 0;
+    uint64_t seed = 0;
+    Boundary boundary = Boundary::Torus;
+    // With the thread count the board actually ran with
+    EngineConfig engine;
+    std::string rule = "B3/S23";
+    // Budget of the rewind history in bytes, 0 for none
+    size_t history = 0;
+    bool pixels = false;
+
+    std::string to_string() const;
+
+    // Throws Error if a setting is missing or invalid
+    static SessionStart parse(const std::string &args);
+};
+
+class SessionRecorder
+{
+public:
+    // Throws Error if the file can't be created
+    SessionRecorder(const std::string &path);
+
+    // Every line is flushed, a session that ends in a crash is still replayable
+    void record(uint64_t ticks, uint64_t generation, const std::string &command);
+
+    const std::string &path() const
+    {
+        return m_path;
+    }
+
+private:
+    std::string m_path;
+    std::ofstream m_out;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Runs a recorded session as fast as possible and reports how long the
+// generations took, per command and overall. The time of every generation is
+// written to timings_path as CSV if it is not empty. Throws Error if the
+// session can't be read or doesn't replay.
+void replay_session(std::ostream &out, const std::string &path, const std::string &timings_path = "");
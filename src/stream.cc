@@ -0,0 +1,350 @@
+#include "stream.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace stream;
+
+namespace
+{
+    size_t align8(size_t size)
+    {
+        return (size + 7) & ~size_t(7);
+    }
+
+    void *map_shared(const std::string &name, size_t &size, bool create)
+    {
+#ifdef _WIN32
+        throw Error("Shared memory streams are not supported on this platform");
+#else
+        // A stream has exactly one producer, taking over an existing one would
+        // reset its ring under its readers
+        int fd = shm_open(name.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0644);
+
+        if (fd == -1 && create && errno == EEXIST)
+        {
+            throw Error("Shared memory " + name + " is already in use, remove /dev/shm" + name + " if it is stale");
+        }
+        else if (fd == -1)
+        {
+            throw Error("Could not open shared memory " + name + ": " + strerror(errno));
+        }
+
+        struct stat st;
+
+        if (create ? ftruncate(fd, size) != 0 : fstat(fd, &st) != 0)
+        {
+            close(fd);
+
+            if (create)
+            {
+                shm_unlink(name.c_str());
+            }
+
+            throw Error("Could not size shared memory " + name + ": " + strerror(errno));
+        }
+
+        if (!create)
+        {
+            size = st.st_size;
+
+            if (size < sizeof(StreamHeader))
+            {
+                close(fd);
+                throw Error("Shared memory " + name + " is not a delta stream");
+            }
+        }
+
+        void *ptr = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (ptr == MAP_FAILED)
+        {
+            if (create)
+            {
+                shm_unlink(name.c_str());
+            }
+
+            throw Error("Could not map shared memory " + name + ": " + strerror(errno));
+        }
+
+        return ptr;
+#endif
+    }
+
+    void unmap_shared(void *ptr, size_t size)
+    {
+#ifndef _WIN32
+        munmap(ptr, size);
+#endif
+    }
+}
+
+//
+// DeltaStream
+//
+
+DeltaStream::DeltaStream(std::string name, int width, int height, int keyframe_interval, size_t capacity)
+    : m_name(name)
+{
+    int words_per_row = (width + 63) / 64;
+    m_grid_words = words_per_row * height;
+
+    // Keep several keyframes worth of history so that readers have time to catch up
+    size_t keyframe_size = align8(sizeof(RecordHeader) + m_grid_words * sizeof(uint64_t));
+    capacity = align8(std::max({capacity, keyframe_size * 8, size_t(1) << 20}));
+
+    m_map_size = sizeof(StreamHeader) + capacity;
+    void *ptr = map_shared(m_name, m_map_size, true);
+
+    m_header = new (ptr) StreamHeader{};
+    m_header->version = VERSION;
+    m_header->width = width;
+    m_header->height = height;
+    m_header->words_per_row = words_per_row;
+    m_header->keyframe_interval = keyframe_interval;
+    m_header->capacity = capacity;
+    m_ring = (uint8_t *)ptr + sizeof(StreamHeader);
+
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = MAGIC;
+}
+
+DeltaStream::~DeltaStream()
+{
+    unmap_shared(m_header, m_map_size);
+#ifndef _WIN32
+    shm_unlink(m_name.c_str());
+#endif
+}
+
+void DeltaStream::publish(uint64_t generation, const uint64_t *packed,
+                          const std::vector<std::vector<WordChange>> &changes)
+{
+    size_t count = 0;
+
+    for (const auto &c : changes)
+    {
+        count += c.size();
+    }
+
+    size_t delta_size = align8(count * sizeof(uint32_t)) + count * sizeof(uint64_t);
+    bool keyframe = m_need_keyframe || generation >= m_last_keyframe + m_header->keyframe_interval;
+
+    if (keyframe || delta_size >= m_grid_words * sizeof(uint64_t))
+    {
+        uint8_t *payload = begin_record(KEYFRAME, generation, m_grid_words, m_grid_words * sizeof(uint64_t));
+        memcpy(payload, packed, m_grid_words * sizeof(uint64_t));
+        end_record();
+
+        m_header->keyframe.store(m_record_start, std::memory_order_release);
+        m_last_keyframe = generation;
+        m_need_keyframe = false;
+    }
+    else
+    {
+        uint8_t *payload = begin_record(DELTA, generation, count, delta_size);
+        uint32_t *offsets = (uint32_t *)payload;
+        uint64_t *words = (uint64_t *)(payload + align8(count * sizeof(uint32_t)));
+
+        for (const auto &c : changes)
+        {
+            for (const auto &change : c)
+            {
+                *offsets++ = change.offset;
+                *words++ = change.word;
+            }
+        }
+
+        end_record();
+    }
+}
+
+uint8_t *DeltaStream::begin_record(RecordType type, uint64_t generation, uint32_t count, size_t payload)
+{
+    const uint64_t capacity = m_header->capacity;
+    size_t size = align8(sizeof(RecordHeader) + payload);
+    size_t phys = m_pos % capacity;
+    size_t skip = capacity - phys < size ? capacity - phys : 0;
+    assert(size <= capacity);
+
+    // Readers use this to detect that the data they read was overwritten
+    m_header->reserved.store(m_pos + skip + size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (skip)
+    {
+        if (skip >= sizeof(RecordHeader))
+        {
+            *(RecordHeader *)(m_ring + phys) = RecordHeader{generation, skip, PAD, 0};
+        }
+
+        m_pos += skip;
+        phys = 0;
+    }
+
+    *(RecordHeader *)(m_ring + phys) = RecordHeader{generation, size, type, count};
+    m_record_start = m_pos;
+    m_next_pos = m_pos + size;
+    return m_ring + phys + sizeof(RecordHeader);
+}
+
+void DeltaStream::end_record()
+{
+    m_pos = m_next_pos;
+    m_header->head.store(m_pos, std::memory_order_release);
+}
+
+//
+// DeltaReader
+//
+
+DeltaReader::DeltaReader(std::string name)
+{
+    void *ptr = map_shared(name, m_map_size, false);
+    m_header = (const StreamHeader *)ptr;
+    m_ring = (const uint8_t *)ptr + sizeof(StreamHeader);
+
+    if (m_header->magic != MAGIC || m_header->version != VERSION ||
+        m_map_size < sizeof(StreamHeader) + m_header->capacity)
+    {
+        unmap_shared(ptr, m_map_size);
+        throw Error("Shared memory " + name + " is not a compatible delta stream");
+    }
+}
+
+DeltaReader::~DeltaReader()
+{
+    unmap_shared((void *)m_header, m_map_size);
+}
+
+bool DeltaReader::poll(std::vector<uint64_t> &grid, uint64_t &generation)
+{
+    bool updated = false;
+
+    if (!m_synced)
+    {
+        if (!resync(grid, generation))
+        {
+            return false;
+        }
+
+        updated = true;
+    }
+
+    uint64_t head = m_header->head.load(std::memory_order_acquire);
+
+    while (m_pos < head)
+    {
+        uint64_t next;
+
+        if (apply(m_pos, grid, generation, next))
+        {
+            m_pos = next;
+        }
+        else if (resync(grid, generation))
+        {
+            head = m_header->head.load(std::memory_order_acquire);
+        }
+        else
+        {
+            break;
+        }
+
+        updated = true;
+    }
+
+    return updated;
+}
+
+bool DeltaReader::resync(std::vector<uint64_t> &grid, uint64_t &generation)
+{
+    grid.resize(m_header->words_per_row * m_header->height);
+
+    // Only fails if the producer laps us while we copy the keyframe
+    for (int attempt = 0; attempt < 16; attempt++)
+    {
+        if (m_header->head.load(std::memory_order_acquire) == 0)
+        {
+            return false;
+        }
+
+        uint64_t pos = m_header->keyframe.load(std::memory_order_acquire);
+        uint64_t next;
+
+        if (apply(pos, grid, generation, next))
+        {
+            m_pos = next;
+            m_synced = true;
+            return true;
+        }
+    }
+
+    m_synced = false;
+    return false;
+}
+
+bool DeltaReader::valid(uint64_t pos) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_header->reserved.load(std::memory_order_relaxed) - pos <= m_header->capacity;
+}
+
+bool DeltaReader::apply(uint64_t pos, std::vector<uint64_t> &grid, uint64_t &generation, uint64_t &next)
+{
+    const uint64_t capacity = m_header->capacity;
+    size_t phys = pos % capacity;
+
+    if (capacity - phys < sizeof(RecordHeader))
+    {
+        next = pos + capacity - phys;
+        return true;
+    }
+
+    RecordHeader rec;
+    memcpy(&rec, m_ring + phys, sizeof(rec));
+
+    if (!valid(pos) || rec.size < sizeof(RecordHeader) || rec.size > capacity - phys)
+    {
+        return false;
+    }
+
+    const uint8_t *payload = m_ring + phys + sizeof(RecordHeader);
+
+    if (rec.type == KEYFRAME && rec.count == grid.size())
+    {
+        memcpy(grid.data(), payload, grid.size() * sizeof(uint64_t));
+        generation = rec.generation;
+    }
+    else if (rec.type == DELTA && sizeof(RecordHeader) + align8(rec.count * sizeof(uint32_t)) + rec.count * sizeof(uint64_t) <= rec.size)
+    {
+        const uint32_t *offsets = (const uint32_t *)payload;
+        const uint64_t *words = (const uint64_t *)(payload + align8(rec.count * sizeof(uint32_t)));
+
+        for (uint32_t i = 0; i < rec.count; i++)
+        {
+            if (offsets[i] < grid.size())
+            {
+                grid[offsets[i]] = words[i];
+            }
+        }
+
+        generation = rec.generation;
+    }
+    else if (rec.type != PAD)
+    {
+        return false;
+    }
+
+    next = pos + rec.size;
+    return valid(pos);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "common.hh"
+
+#include <atomic>
+#include <vector>
+
+// A changed word of the packed grid, offset is the index of the word
+struct WordChange
+{
+    uint32_t offset;
+    uint64_t word;
+};
+
+// Shared memory layout of a delta stream:
+//
+//   StreamHeader | ring of records
+//
+// Records are 8-byte aligned and never wrap around the end of the ring. They
+// are addressed by their monotonic byte position, the physical offset being
+// position % capacity. A record is a RecordHeader followed by its payload:
+//
+//   KEYFRAME  words_per_row * height words, the full packed grid
+//   DELTA     count uint32 word offsets, padded to 8 bytes, then count words
+//   PAD       nothing, skips to the start of the ring
+namespace stream
+{
+    static constexpr uint32_t MAGIC = 0x4c464c46;
+    static constexpr uint32_t VERSION = 1;
+
+    enum RecordType : uint32_t
+    {
+        KEYFRAME = 1,
+        DELTA = 2,
+        PAD = 3,
+    };
+
+    struct RecordHeader
+    {
+        uint64_t generation;
+        uint64_t size;
+        uint32_t type;
+        uint32_t count;
+    };
+
+    struct StreamHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t words_per_row;
+        uint32_t keyframe_interval;
+        uint64_t capacity;
+
+        // End of the last published record
+        std::atomic<uint64_t> head;
+        // End of the record being written, everything before reserved - capacity
+        // may have been overwritten
+        std::atomic<uint64_t> reserved;
+        // Start of the latest keyframe
+        std::atomic<uint64_t> keyframe;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+}
+
+// Publishes per-generation deltas of the packed grid into a single-producer,
+// multi-consumer ring buffer in shared memory. Consumers never block the
+// producer, ones that fall behind resync from the latest keyframe.
+class DeltaStream
+{
+public:
+    // Creates the shared memory and removes it when destroyed. Throws Error if
+    // it already exists, e.g. because another process is streaming to it.
+    DeltaStream(std::string name, int width, int height, int keyframe_interval = 64, size_t capacity = 0);
+    ~DeltaStream();
+
+    // Called once per generation with the packed grid and the words that changed
+    // since the previous call, grouped by worker. The first call always writes a
+    // keyframe.
+    void publish(uint64_t generation, const uint64_t *packed,
+                 const std::vector<std::vector<WordChange>> &changes);
+
+    // Makes the next publish() write a keyframe, e.g. after the grid was edited
+    void invalidate()
+    {
+        m_need_keyframe = true;
+    }
+
+    const std::string &name() const
+    {
+        return m_name;
+    }
+
+private:
+    uint8_t *begin_record(stream::RecordType type, uint64_t generation, uint32_t count, size_t payload);
+    void end_record();
+
+    std::string m_name;
+    size_t m_map_size;
+    stream::StreamHeader *m_header{nullptr};
+    uint8_t *m_ring{nullptr};
+    size_t m_grid_words;
+    uint64_t m_pos{0};
+    uint64_t m_record_start{0};
+    uint64_t m_next_pos{0};
+    uint64_t m_last_keyframe{0};
+    bool m_need_keyframe{true};
+};
+
+// Follows a DeltaStream from another process. Records are applied straight out
+// of the shared memory and validated afterwards.
+class DeltaReader
+{
+public:
+    DeltaReader(std::string name);
+    ~DeltaReader();
+
+    int width() const
+    {
+        return m_header->width;
+    }
+
+    int height() const
+    {
+        return m_header->height;
+    }
+
+    int words_per_row() const
+    {
+        return m_header->words_per_row;
+    }
+
+    // Brings grid up to date with the stream. Returns false if nothing new was
+    // published since the last call.
+    bool poll(std::vector<uint64_t> &grid, uint64_t &generation);
+
+private:
+    bool resync(std::vector<uint64_t> &grid, uint64_t &generation);
+    bool apply(uint64_t pos, std::vector<uint64_t> &grid, uint64_t &generation, uint64_t &next);
+    bool valid(uint64_t pos) const;
+
+    size_t m_map_size;
+    const stream::StreamHeader *m_header{nullptr};
+    const uint8_t *m_ring{nullptr};
+    uint64_t m_pos{0};
+    bool m_synced{false};
+};
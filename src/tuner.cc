@@ -0,0 +1,214 @@
+#include "tuner.hh"
+
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Every candidate runs for at least this long and this many generations
+    const std::chrono::milliseconds MIN_TIME{20};
+    const int MIN_GENERATIONS = 4;
+
+    const int TILE_SIZES[] = {16, 32, 64, 128};
+
+    double time_engine(int width, int height, EngineConfig engine, std::ostream *log)
+    {
+        using namespace std::chrono;
+        Game game(height, width, Boundary::Torus, engine, 1);
+
+        // The first generation pays for the page faults
+        game.tick();
+
+        auto start = steady_clock::now();
+        auto elapsed = steady_clock::duration::zero();
+        int generations = 0;
+
+        while (generations < MIN_GENERATIONS || elapsed < MIN_TIME)
+        {
+            game.tick();
+            generations++;
+            elapsed = steady_clock::now() - start;
+        }
+
+        double ms = duration_cast<nanoseconds>(elapsed).count() / 1e6 / generations;
+
+        if (log)
+        {
+            *log << std::setw(10) << layout_name(engine.layout);
+
+            if (engine.layout == Layout::Tiled)
+            {
+                *log << " " << std::setw(4) << engine.tile_size;
+            }
+            else
+            {
+                *log << "     ";
+            }
+
+            *log << std::setw(4) << game.threads() << " threads " << std::fixed << std::setprecision(3)
+                 << ms << " ms/gen" << std::endl;
+        }
+
+        return ms;
+    }
+}
+
+Tuner::Tuner(std::string cache_path)
+    : m_cache_path(cache_path)
+{
+}
+
+EngineConfig Tuner::tune(int width, int height, std::ostream *log)
+{
+    const std::string host = host_id();
+
+    {
+        std::ifstream in(m_cache_path);
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string line_host;
+            std::string layout;
+            int w;
+            int h;
+            EngineConfig engine;
+
+            if (fields >> line_host >> w >> h >> layout >> engine.tile_size >> engine.threads &&
+                line_host == host && w == width && h == height)
+            {
+                try
+                {
+                    engine.layout = parse_layout(layout);
+
+                    // The same checks as Game, a hand edited or stale line
+                    // must not keep the game from starting
+                    if (engine.tile_size >= 8 && std::has_single_bit(unsigned(engine.tile_size)) && engine.threads > 0)
+                    {
+                        return engine;
+                    }
+                }
+                catch (const Error &)
+                {
+                    // A broken line, measure again
+                }
+            }
+        }
+    }
+
+    EngineConfig engine = measure(width, height, log);
+
+    // The cache is only an optimization, failing to write it is not an error
+    std::error_code err;
+    std::filesystem::create_directories(std::filesystem::path(m_cache_path).parent_path(), err);
+    std::ofstream out(m_cache_path, std::ios::app);
+    out << host << " " << width << " " << height << " " << layout_name(engine.layout) << " "
+        << engine.tile_size << " " << engine.threads << "\n";
+
+    return engine;
+}
+
+EngineConfig Tuner::measure(int width, int height, std::ostream *log)
+{
+    EngineConfig best;
+    best.threads = 1;
+    double best_ms = time_engine(width, height, best, log);
+
+    // Powers of two up to the number of hardware threads, and that number
+    std::vector<int> thread_counts;
+
+    for (int threads = 2; threads < THREADS; threads *= 2)
+    {
+        thread_counts.push_back(threads);
+    }
+
+    if (THREADS > 1)
+    {
+        thread_counts.push_back(THREADS);
+    }
+
+    for (int threads : thread_counts)
+    {
+        if (threads > height)
+        {
+            break;
+        }
+
+        EngineConfig engine;
+        engine.threads = threads;
+        double ms = time_engine(width, height, engine, log);
+
+        if (ms < best_ms)
+        {
+            best = engine;
+            best_ms = ms;
+        }
+    }
+
+    for (int tile : TILE_SIZES)
+    {
+        // A tile much larger than the board is just the row-major layout with padding
+        if (tile > 2 * std::max(width, height))
+        {
+            break;
+        }
+
+        EngineConfig engine{Layout::Tiled, tile, best.threads};
+        double ms = time_engine(width, height, engine, log);
+
+        if (ms < best_ms)
+        {
+            best = engine;
+            best_ms = ms;
+        }
+    }
+
+    return best;
+}
+
+std::string Tuner::host_id()
+{
+    std::string host = "unknown";
+
+#ifdef _WIN32
+    if (const char *name = std::getenv("COMPUTERNAME"))
+    {
+        host = name;
+    }
+#else
+    char name[256] = {};
+
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0])
+    {
+        host = name;
+    }
+#endif
+
+    return host + "/" + std::to_string(THREADS);
+}
+
+std::string Tuner::default_cache_path()
+{
+#ifdef _WIN32
+    const char *dir = std::getenv("LOCALAPPDATA");
+    return dir ? std::string(dir) + "\\fast_life_tune.txt" : "fast_life_tune.txt";
+#else
+    if (const char *dir = std::getenv("XDG_CACHE_HOME"))
+    {
+        return std::string(dir) + "/fast_life_tune.txt";
+    }
+
+    const char *home = std::getenv("HOME");
+    return home ? std::string(home) + "/.cache/fast_life_tune.txt" : "fast_life_tune.txt";
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "game.hh"
+
+#include <ostream>
+
+// Picks the fastest engine configuration for a board size on this host by
+// timing a few generations of the candidates. The thread count is chosen first
+// with the row-major layout, then the tile sizes are tried with that many
+// threads.
+//
+// The results are cached in a text file with one line per host and board size,
+// so only the first run with a given size pays for the calibration.
+class Tuner
+{
+public:
+    Tuner(std::string cache_path = default_cache_path());
+
+    // Returns the cached configuration, or measures and caches it. The progress
+    // of the measurement is written to log if it is not null.
+    EngineConfig tune(int width, int height, std::ostream *log = nullptr);
+
+    // Times the candidates without looking at the cache
+    static EngineConfig measure(int width, int height, std::ostream *log = nullptr);
+
+    // Identifies the machine in the cache, the host name and the number of
+    // hardware threads
+    static std::string host_id();
+
+    static std::string default_cache_path();
+
+private:
+    std::string m_cache_path;
+};
@@ -0,0 +1,91 @@
+#include "barrier.hh"
+#include "check.hh"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr int THREADS = 6;
+    constexpr int PHASES = 20000;
+
+    struct Done
+    {
+        const std::atomic<int> *arrived;
+        int *completions;
+
+        void operator()() noexcept
+        {
+            // The even phases of the loop count the arrivals, everyone has
+            // arrived before the completion runs
+            int phase = *completions;
+
+            if (phase < 2 * PHASES && phase % 2 == 0)
+            {
+                CHECK(arrived->load() == (phase / 2 + 1) * THREADS);
+            }
+
+            ++*completions;
+        }
+    };
+
+    // Half of the threads leave with arrive_and_drop, the rest run two more
+    // phases on their own
+    void stress(int64_t max_spin_ns)
+    {
+        std::atomic<int> arrived{0};
+        std::atomic<int> errors{0};
+        int completions = 0;
+        SpinBarrier<Done> barrier(THREADS, Done{&arrived, &completions}, max_spin_ns);
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < THREADS; i++)
+        {
+            threads.emplace_back(
+                [&, i]()
+                {
+                    for (int phase = 0; phase < PHASES; phase++)
+                    {
+                        arrived.fetch_add(1);
+                        barrier.arrive_and_wait();
+
+                        if (arrived.load() < (phase + 1) * THREADS)
+                        {
+                            errors++;
+                        }
+
+                        barrier.arrive_and_wait();
+                    }
+
+                    if (i % 2)
+                    {
+                        barrier.arrive_and_drop();
+                    }
+                    else
+                    {
+                        barrier.arrive_and_wait();
+                        barrier.arrive_and_wait();
+                    }
+                });
+        }
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        CHECK(errors == 0);
+        CHECK(completions == 2 * PHASES + 2);
+    }
+}
+
+int main()
+{
+    // Parks right away
+    stress(0);
+
+    // Spins as long as the phases are short, on a single core host this is
+    // the yield path
+    stress(SpinBarrier<>::MAX_SPIN_NS);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "census.hh"
+#include "check.hh"
+
+#include <map>
+#include <random>
+
+namespace
+{
+    struct Object
+    {
+        const char *rle;
+        ObjectKind kind;
+        int period;
+        int dx;
+        int dy;
+    };
+
+    const Object OBJECTS[] = {
+        {"2o$2o!", ObjectKind::StillLife, 0, 0, 0},
+        {"b2o$o2bo$b2o!", ObjectKind::StillLife, 0, 0, 0},
+        {"2o$obo$bo!", ObjectKind::StillLife, 0, 0, 0},
+        {"3o!", ObjectKind::Oscillator, 2, 0, 0},
+        {"2o$o$3bo$2b2o!", ObjectKind::Oscillator, 2, 0, 0},
+        {"b3o$3o!", ObjectKind::Oscillator, 2, 0, 0},
+        {"bo$2bo$3o!", ObjectKind::Spaceship, 4, 1, 1},
+        {"bo2bo$o4b$o3bo$4o!", ObjectKind::Spaceship, 4, 2, 0},
+    };
+
+    constexpr int WIDTH = 200;
+    constexpr int HEIGHT = 150;
+
+    Snapshot empty_board(int width, int height)
+    {
+        Snapshot snapshot;
+        snapshot.width = width;
+        snapshot.height = height;
+        snapshot.words_per_row = (width + 63) / 64;
+        snapshot.bits.assign(size_t(snapshot.words_per_row) * height, 0);
+        return snapshot;
+    }
+
+    // Sets a cell up to a board's size outside of it, like the halo does
+    void set(Snapshot &snapshot, Boundary boundary, int x, int y)
+    {
+        if (boundary == Boundary::Klein && (y < 0 || y >= snapshot.height))
+        {
+            x = snapshot.width - 1 - x;
+        }
+
+        x = (x + snapshot.width) % snapshot.width;
+        y = (y + snapshot.height) % snapshot.height;
+        snapshot.bits[size_t(y) * snapshot.words_per_row + x / 64] |= uint64_t(1) << (x % 64);
+    }
+
+    void place(Snapshot &snapshot, Boundary boundary, const Pattern &pattern, int x, int y, int symmetry)
+    {
+        for (int py = 0; py < pattern.height; py++)
+        {
+            for (int px = 0; px < pattern.width; px++)
+            {
+                if (pattern.alive(px, py))
+                {
+                    int tx = symmetry & 1 ? pattern.width - 1 - px : px;
+                    int ty = symmetry & 2 ? pattern.height - 1 - py : py;
+
+                    if (symmetry & 4)
+                    {
+                        std::swap(tx, ty);
+                    }
+
+                    set(snapshot, boundary, x + tx, y + ty);
+                }
+            }
+        }
+    }
+
+    // The canonical RLE of every object, from a board with only that object
+    std::vector<std::string> canonical_forms()
+    {
+        Census census(Rule::parse("B3/S23"), 1);
+        std::vector<std::string> forms;
+
+        for (const Object &object : OBJECTS)
+        {
+            Snapshot snapshot = empty_board(20, 20);
+            place(snapshot, Boundary::Dead, Pattern::parse_rle(object.rle), 8, 8, 0);
+            auto result = census.take(snapshot, Boundary::Dead);
+
+            CHECK(result.size() == 1 && result[0].count == 1);
+            CHECK(result[0].kind == object.kind && result[0].period == object.period);
+            CHECK(result[0].dx == object.dx && result[0].dy == object.dy);
+            forms.push_back(result[0].rle);
+        }
+
+        return forms;
+    }
+
+    // A grid of objects in random orientations, the first row and column cross
+    // the edges of the board
+    void grid(Boundary boundary, int threads, const std::vector<std::string> &forms)
+    {
+        std::mt19937 gen(threads);
+        Snapshot snapshot = empty_board(WIDTH, HEIGHT);
+        std::map<std::string, uint64_t> expected;
+        int k = 0;
+
+        for (int y = 0; y < HEIGHT; y += 10)
+        {
+            for (int x = 0; x < WIDTH; x += 10)
+            {
+                int i = k++ % std::size(OBJECTS);
+                place(snapshot, boundary, Pattern::parse_rle(OBJECTS[i].rle), x == 0 ? -2 : x, y == 0 ? -1 : y,
+                      gen() % 8);
+                expected[forms[i]]++;
+            }
+        }
+
+        Census census(Rule::parse("B3/S23"), threads);
+
+        // The second board is counted with the classifications and threads of
+        // the first
+        for (int pass = 0; pass < 2; pass++)
+        {
+            std::map<std::string, uint64_t> counted;
+
+            for (const auto &entry : census.take(snapshot, boundary))
+            {
+                counted[entry.rle] += entry.count;
+            }
+
+            CHECK(counted == expected);
+        }
+    }
+}
+
+int main()
+{
+    auto forms = canonical_forms();
+
+    for (int threads : {1, 3, 7})
+    {
+        grid(Boundary::Torus, threads, forms);
+        grid(Boundary::Klein, threads, forms);
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// The tests are plain executables, a failed check prints where it was and
+// exits with a non-zero status for ctest
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            std::exit(1);                                                      \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_THROWS(expr)                                                     \
+    do                                                                         \
+    {                                                                          \
+        bool thrown = false;                                                   \
+        try                                                                    \
+        {                                                                      \
+            (void)(expr);                                                      \
+        }                                                                      \
+        catch (const std::exception &)                                         \
+        {                                                                      \
+            thrown = true;                                                     \
+        }                                                                      \
+        if (!thrown)                                                           \
+        {                                                                      \
+            std::fprintf(stderr, "%s:%d: %s did not throw\n", __FILE__, __LINE__, #expr); \
+            std::exit(1);                                                      \
+        }                                                                      \
+    } while (0)
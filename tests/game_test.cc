@@ -0,0 +1,169 @@
+#include "check.hh"
+#include "game.hh"
+
+#include <vector>
+
+namespace
+{
+    constexpr int WIDTH = 70;
+    constexpr int HEIGHT = 45;
+    constexpr int GENERATIONS = 8;
+
+    const char *const RULES[] = {
+        "B3/S23",
+        "B36/S125",
+        // Star Wars, Generations
+        "B2/S345/C4",
+        // Bosco's rule, Larger than Life
+        "R5,C0,M1,S34..58,B34..45,NM",
+        "R2,C3,M0,S3..6,B4..5,NM",
+    };
+
+    // One state per cell like in the RLE format: 0 is dead, 1 alive and the
+    // rest dying. Steps the board one cell at a time.
+    struct Reference
+    {
+        Rule rule;
+        Boundary boundary;
+        int width;
+        int height;
+        std::vector<uint8_t> cells;
+
+        // Follows a neighbour across the edge, false if it is always dead
+        bool wrap(int &x, int &y) const
+        {
+            switch (boundary)
+            {
+            case Boundary::Torus:
+                break;
+            case Boundary::Dead:
+                return x >= 0 && x < width && y >= 0 && y < height;
+            case Boundary::Klein:
+                if (y < 0 || y >= height)
+                {
+                    x = width - 1 - x;
+                }
+                break;
+            case Boundary::Mirror:
+                x = x < 0 ? -x - 1 : x >= width ? 2 * width - x - 1 : x;
+                y = y < 0 ? -y - 1 : y >= height ? 2 * height - y - 1 : y;
+                return true;
+            }
+
+            x = (x % width + width) % width;
+            y = (y % height + height) % height;
+            return true;
+        }
+
+        bool alive(int x, int y) const
+        {
+            return wrap(x, y) && cells[y * width + x] == 1;
+        }
+
+        void step()
+        {
+            std::vector<uint8_t> next(cells.size());
+
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    int count = 0;
+
+                    for (int dy = -rule.range; dy <= rule.range; dy++)
+                    {
+                        for (int dx = -rule.range; dx <= rule.range; dx++)
+                        {
+                            count += (dx || dy || rule.center) && alive(x + dx, y + dy);
+                        }
+                    }
+
+                    int state = cells[y * width + x];
+                    bool survives = rule.larger_than_life()
+                                        ? count >= rule.survival_min && count <= rule.survival_max
+                                        : (rule.survival >> count) & 1;
+                    bool born = rule.larger_than_life() ? count >= rule.birth_min && count <= rule.birth_max
+                                                        : (rule.birth >> count) & 1;
+
+                    if (state == 1)
+                    {
+                        next[y * width + x] = survives ? 1 : rule.generations() ? 2 : 0;
+                    }
+                    else if (state == 0)
+                    {
+                        next[y * width + x] = born;
+                    }
+                    else
+                    {
+                        next[y * width + x] = state + 1 < rule.states ? state + 1 : 0;
+                    }
+                }
+            }
+
+            cells.swap(next);
+        }
+    };
+
+    void compare(const char *rule_str, Boundary boundary, EngineConfig engine)
+    {
+        Rule rule = Rule::parse(rule_str);
+        Game game(HEIGHT, WIDTH, boundary, engine, 11);
+        game.set_snapshots(true);
+        game.set_rule(rule);
+
+        // The rule takes effect with no dying cells on the board
+        game.tick();
+        auto snapshot = game.snapshot();
+        Reference reference{rule, boundary, WIDTH, HEIGHT, std::vector<uint8_t>(WIDTH * HEIGHT)};
+
+        for (int y = 0; y < HEIGHT; y++)
+        {
+            for (int x = 0; x < WIDTH; x++)
+            {
+                reference.cells[y * WIDTH + x] = snapshot->alive(x, y);
+            }
+        }
+
+        for (int i = 0; i < GENERATIONS; i++)
+        {
+            game.tick();
+            reference.step();
+            snapshot = game.snapshot();
+
+            for (int y = 0; y < HEIGHT; y++)
+            {
+                for (int x = 0; x < WIDTH; x++)
+                {
+                    if (snapshot->alive(x, y) != (reference.cells[y * WIDTH + x] == 1))
+                    {
+                        std::fprintf(stderr, "%s %s %s: cell %d, %d differs on generation %d\n", rule_str,
+                                     boundary_name(boundary), layout_name(engine.layout), x, y, i + 1);
+                        std::exit(1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    const EngineConfig engines[] = {
+        {Layout::RowMajor, 64, 3},
+        {Layout::Tiled, 8, 3},
+        {Layout::Tiled, 16, 1},
+    };
+
+    for (const auto &engine : engines)
+    {
+        for (Boundary boundary : {Boundary::Torus, Boundary::Dead, Boundary::Klein, Boundary::Mirror})
+        {
+            for (const char *rule : RULES)
+            {
+                compare(rule, boundary, engine);
+            }
+        }
+    }
+
+    return 0;
+}
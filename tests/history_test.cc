@@ -0,0 +1,152 @@
+#include "check.hh"
+#include "game.hh"
+#include "history.hh"
+
+#include <map>
+#include <random>
+
+namespace
+{
+    constexpr int WIDTH = 130;
+    constexpr int HEIGHT = 70;
+    constexpr int WORDS_PER_ROW = (WIDTH + 63) / 64;
+    constexpr int WORDS = WORDS_PER_ROW * HEIGHT;
+
+    // Grids that hit the different cases of the encoding: all zero, all ones,
+    // sparse and dense words
+    std::vector<uint64_t> make_grid(std::mt19937_64 &gen, int kind)
+    {
+        std::vector<uint64_t> grid(WORDS);
+
+        for (auto &word : grid)
+        {
+            switch (kind % 4)
+            {
+            case 0:
+                word = 0;
+                break;
+            case 1:
+                word = ~uint64_t(0);
+                break;
+            case 2:
+                word = gen() % 8 == 0 ? uint64_t(1) << (gen() % 64) : 0;
+                break;
+            default:
+                word = gen();
+                break;
+            }
+        }
+
+        // Only the bits of the board are kept
+        for (int y = 0; y < HEIGHT; y++)
+        {
+            grid[(y + 1) * WORDS_PER_ROW - 1] &= (uint64_t(1) << (WIDTH % 64)) - 1;
+        }
+
+        return grid;
+    }
+
+    void codec()
+    {
+        std::mt19937_64 gen(1);
+        History history(WIDTH, HEIGHT, size_t(1) << 30, 8);
+        std::vector<std::vector<uint64_t>> truth;
+
+        for (uint64_t generation = 1; generation <= 100; generation++)
+        {
+            truth.push_back(make_grid(gen, int(gen() % 4)));
+            history.record(generation, truth.back().data());
+        }
+
+        CHECK(history.first() == 1 && history.last() == 100);
+
+        for (uint64_t generation = 1; generation <= 100; generation++)
+        {
+            auto snapshot = history.reconstruct(generation);
+            CHECK(snapshot && snapshot->generation == generation);
+            CHECK(snapshot->bits == truth[generation - 1]);
+        }
+
+        CHECK(!history.reconstruct(0));
+        CHECK(!history.reconstruct(101));
+
+        // Recording a held generation again drops the ones after it
+        history.record(50, truth[0].data());
+        CHECK(history.last() == 50);
+        CHECK(history.reconstruct(50)->bits == truth[0]);
+        CHECK(history.reconstruct(49)->bits == truth[48]);
+        CHECK(!history.reconstruct(51));
+
+        // A gap starts over
+        history.record(80, truth[1].data());
+        CHECK(history.first() == 80 && history.last() == 80);
+        CHECK(history.reconstruct(80)->bits == truth[1]);
+    }
+
+    void budget()
+    {
+        std::mt19937_64 gen(2);
+        History history(WIDTH, HEIGHT, 20000, 8);
+        std::map<uint64_t, std::vector<uint64_t>> truth;
+
+        for (uint64_t generation = 1; generation <= 500; generation++)
+        {
+            truth[generation] = make_grid(gen, 3);
+            history.record(generation, truth[generation].data());
+        }
+
+        // Whole keyframe groups are dropped from the front
+        CHECK(history.memory_used() <= 20000 + 2 * WORDS * 8 * 8);
+        CHECK(history.first() > 1 && history.last() == 500);
+        CHECK((history.first() - 1) % 8 == 0);
+        CHECK(!history.reconstruct(history.first() - 1));
+
+        for (uint64_t generation = history.first(); generation <= history.last(); generation++)
+        {
+            CHECK(history.reconstruct(generation)->bits == truth[generation]);
+        }
+    }
+
+    // Rewinds a running game, which keeps recording from there
+    void rewind()
+    {
+        History history(WIDTH, HEIGHT, size_t(1) << 30, 16);
+        std::map<uint64_t, std::vector<uint64_t>> truth;
+
+        {
+            Game game(HEIGHT, WIDTH, Boundary::Torus, {}, 7);
+            game.set_history(&history);
+            game.set_snapshots(true);
+
+            for (int i = 0; i < 300; i++)
+            {
+                game.tick();
+                auto snapshot = game.snapshot();
+                truth[snapshot->generation] = snapshot->bits;
+
+                if (i == 150)
+                {
+                    auto target = history.reconstruct(snapshot->generation - 40);
+                    CHECK(target);
+                    game.restore(target);
+                }
+            }
+        }
+
+        // Stopping the game records nothing
+        CHECK(history.first() == 1 && history.last() == truth.rbegin()->first);
+
+        for (auto &[generation, bits] : truth)
+        {
+            CHECK(history.reconstruct(generation)->bits == bits);
+        }
+    }
+}
+
+int main()
+{
+    codec();
+    budget();
+    rewind();
+    return 0;
+}
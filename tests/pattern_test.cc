@@ -0,0 +1,108 @@
+#include "check.hh"
+#include "game.hh"
+#include "pattern.hh"
+
+#include <string>
+
+namespace
+{
+    void round_trip()
+    {
+        Pattern glider = Pattern::parse_rle("#C A glider\nx = 3, y = 3, rule = B3/S23\nbo$2bo$3o!\n");
+        CHECK(glider.width == 3 && glider.height == 3);
+        CHECK(glider.rule == "B3/S23");
+        CHECK(glider.alive(1, 0) && glider.alive(2, 1) && glider.alive(0, 2) && !glider.alive(0, 0));
+
+        // The header is optional and runs may span lines
+        Pattern bare = Pattern::parse_rle("2o\n3b$\n!");
+        CHECK(bare.width == 5 && bare.height == 1);
+
+        Snapshot snapshot;
+        snapshot.width = 130;
+        snapshot.height = 4;
+        snapshot.words_per_row = 3;
+        snapshot.bits.resize(12);
+        snapshot.bits[0] = 0x8000000000000001;
+        snapshot.bits[8] = 0x3;
+        snapshot.bits[11] = 0xffff;
+
+        Pattern copy = Pattern::parse_rle(to_rle(snapshot, Rule::parse("B3/S23")));
+        CHECK(copy.width == snapshot.width && copy.height == snapshot.height);
+
+        for (int y = 0; y < snapshot.height; y++)
+        {
+            for (int x = 0; x < snapshot.width; x++)
+            {
+                CHECK(copy.alive(x, y) == snapshot.alive(x, y));
+            }
+        }
+    }
+
+    void states()
+    {
+        Pattern pattern = Pattern::parse_rle("x = 6, y = 2, rule = B2/S/C30\nAoBX.pA$2pEyO!\n");
+        CHECK(pattern.state(0, 0) == 1 && pattern.state(1, 0) == 1 && pattern.state(2, 0) == 2);
+        CHECK(pattern.state(3, 0) == 24 && pattern.state(4, 0) == 0 && pattern.state(5, 0) == 25);
+        CHECK(pattern.state(0, 1) == 29 && pattern.state(1, 1) == 29 && pattern.state(2, 1) == 255);
+        CHECK(pattern.alive(0, 0) && !pattern.alive(2, 0));
+
+        CHECK_THROWS(Pattern::parse_rle("AY!"));
+        CHECK_THROWS(Pattern::parse_rle("AyP!"));
+        CHECK_THROWS(Pattern::parse_rle("Ap2A!"));
+        CHECK_THROWS(Pattern::parse_rle("Ap!"));
+
+        // A dying cell between two live ones in Brian's Brain. Loaded as
+        // alive, the middle cell would block the births above and below it.
+        Game game(8, 8, Boundary::Dead, {}, 1);
+        game.set_snapshots(true);
+        game.set_rule(Rule::parse("B2/S/C3"));
+        game.clear();
+        game.load(Pattern::parse_rle("ABA!"), 2, 4);
+        game.step(2);
+
+        auto snapshot = game.snapshot();
+
+        for (int y = 0; y < 8; y++)
+        {
+            for (int x = 0; x < 8; x++)
+            {
+                CHECK(snapshot->alive(x, y) == (x == 3 && (y == 3 || y == 5)));
+            }
+        }
+    }
+
+    void malformed()
+    {
+        // Sizes that overflowed or wrapped around
+        CHECK_THROWS(Pattern::parse_rle("x = 100000, y = 100000\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x = 65536, y = 65536\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x = -5, y = 3\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x = 0, y = 3\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x = abc, y = 3\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x = 99999999999, y = 3\nbo!"));
+        CHECK_THROWS(Pattern::parse_rle("x 3, y = 3\nbo!"));
+
+        // Runs that overflowed the count or grow past the limit
+        CHECK_THROWS(Pattern::parse_rle("3000000000o!"));
+        CHECK_THROWS(Pattern::parse_rle("65537o!"));
+        CHECK_THROWS(Pattern::parse_rle("60000b60000o!"));
+        CHECK_THROWS(Pattern::parse_rle("65536$o!"));
+        CHECK_THROWS(Pattern::parse_rle(std::string(40000, '$') + std::string(40000, '$') + "o!"));
+
+        // Characters outside of ASCII are rejected instead of passed to isdigit
+        CHECK_THROWS(Pattern::parse_rle("2o\xe9o!"));
+        CHECK_THROWS(Pattern::parse_rle("2o%o!"));
+
+        // The largest allowed row still parses
+        Pattern row = Pattern::parse_rle("65535bo!");
+        CHECK(row.width == Pattern::MAX_SIZE && row.height == 1 && row.alive(65535, 0));
+    }
+}
+
+int main()
+{
+    round_trip();
+    states();
+    malformed();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "check.hh"
+#include "rule.hh"
+
+namespace
+{
+    void life_like()
+    {
+        Rule life = Rule::parse("B3/S23");
+        CHECK(life.birth == 1 << 3 && life.survival == (1 << 2 | 1 << 3));
+        CHECK(!life.larger_than_life() && !life.generations());
+        CHECK(Rule::parse("23/3") == life);
+        CHECK(Rule::parse("s23/b3") == life);
+        CHECK(Rule::parse("B36/S23").to_string() == "B36/S23");
+        CHECK(Rule::parse("B/S").birth == 0);
+
+        CHECK_THROWS(Rule::parse(""));
+        CHECK_THROWS(Rule::parse("B3S23"));
+        CHECK_THROWS(Rule::parse("B9/S23"));
+        CHECK_THROWS(Rule::parse("B3/S2x"));
+    }
+
+    void generations()
+    {
+        Rule brain = Rule::parse("B2/S/C3");
+        CHECK(brain.states == 3 && brain.generations());
+        CHECK(brain.birth == 1 << 2 && brain.survival == 0);
+        CHECK(Rule::parse("/2/3") == brain);
+        CHECK(Rule::parse("B2/S/G3") == brain);
+        CHECK(Rule::parse(brain.to_string()) == brain);
+        CHECK(Rule::parse("B3/S23/C2") == Rule::parse("B3/S23"));
+
+        CHECK_THROWS(Rule::parse("B2/S/C1"));
+        CHECK_THROWS(Rule::parse("B2/S/C257"));
+        CHECK_THROWS(Rule::parse("B2/S/C"));
+        CHECK_THROWS(Rule::parse("B2/S/Cx"));
+    }
+
+    void larger_than_life()
+    {
+        Rule bosco = Rule::parse("R5,C0,M1,S34..58,B34..45,NM");
+        CHECK(bosco.larger_than_life() && bosco.range == 5 && bosco.center);
+        CHECK(bosco.survival_min == 34 && bosco.survival_max == 58);
+        CHECK(bosco.birth_min == 34 && bosco.birth_max == 45);
+        CHECK(Rule::parse(bosco.to_string()) == bosco);
+        CHECK(Rule::parse("r5,c0,m1,s34..58,b34..45,nm") == bosco);
+
+        // Range one is turned into the Life-like table, counting the centre
+        CHECK(Rule::parse("R1,C0,M1,S3..4,B3,NM") == Rule::parse("B3/S23"));
+        CHECK(Rule::parse("R2,C3,M0,S5,B6,NM").states == 3);
+
+        // An interval with min > max used to wrap the unsigned test of the
+        // kernels and ran as count <= max or count >= min
+        CHECK_THROWS(Rule::parse("R2,C0,M0,S30..2,B30..8,NM"));
+        CHECK_THROWS(Rule::parse("R1,C0,M0,S3..2,B3,NM"));
+        CHECK_THROWS(Rule::parse("R5,C0,M1,S34..58,B45..34,NM"));
+
+        CHECK_THROWS(Rule::parse("R0,C0,M0,S3,B3,NM"));
+        CHECK_THROWS(Rule::parse("R101,C0,M0,S3,B3,NM"));
+        CHECK_THROWS(Rule::parse("R2,C0,M0,S3,NM"));
+        CHECK_THROWS(Rule::parse("R2,C0,M0,S3,B3,NN"));
+        CHECK_THROWS(Rule::parse("R2,C0,M0,S3..,B3,NM"));
+        CHECK_THROWS(Rule::parse("R2,C0,M0,S-1..3,B3,NM"));
+        CHECK_THROWS(Rule::parse("R2,,S3,B3"));
+    }
+}
+
+int main()
+{
+    life_like();
+    generations();
+    larger_than_life();
+    return 0;
+}